@@ -8,7 +8,6 @@
 
 #include "config.h"
 #include "pkg.h"
-#include "porg/file.h"
 #include "filestreeview.h"
 
 using namespace Grop;
@@ -38,10 +37,10 @@ void FilesTreeView::fill_model()
 
 	for (uint i = 0; i < m_pkg.files().size(); ++i) {
 		TreeModel::iterator it = m_model->append();
-		File* file = m_pkg.files()[i];
+		Porg::FileTable::Entry const file = m_pkg.files()[i];
 		(*it)[m_columns.m_file] = file;
-		(*it)[m_columns.m_name] = file->name();
-		(*it)[m_columns.m_size] = file->size();
+		(*it)[m_columns.m_name] = file.name();
+		(*it)[m_columns.m_size] = file.size();
 	}
 }
 
@@ -72,16 +71,16 @@ void FilesTreeView::add_columns()
 void FilesTreeView::name_cell_func(CellRenderer* cell, TreeModel::iterator const& it)
 {
 	CellRendererText* cell_text = static_cast<CellRendererText*>(cell);
-	File* file = (*it)[m_columns.m_file];
-	cell_text->property_foreground() = file->is_missing() ? "red" : "black";
+	Porg::FileTable::Entry const file = (*it)[m_columns.m_file];
+	cell_text->property_foreground() = file.is_missing() ? "red" : "black";
 }
 
 
 void FilesTreeView::size_cell_func(CellRenderer* cell, TreeModel::iterator const& it)
 {
 	CellRendererText* cell_text = static_cast<CellRendererText*>(cell);
-	File* file = (*it)[m_columns.m_file];
-	cell_text->property_foreground() = file->is_missing() ? "red" : "black";
-	cell_text->property_text() = Porg::fmt_size(file->size());
+	Porg::FileTable::Entry const file = (*it)[m_columns.m_file];
+	cell_text->property_foreground() = file.is_missing() ? "red" : "black";
+	cell_text->property_text() = Porg::fmt_size(file.size());
 }
 
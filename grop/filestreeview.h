@@ -32,7 +32,7 @@ class FilesTreeView : public Gtk::TreeView
 			add(m_file);
 		}
 
-		Gtk::TreeModelColumn<File*>			m_file;
+		Gtk::TreeModelColumn<Porg::FileTable::Entry>	m_file;
 		Gtk::TreeModelColumn<Glib::ustring>	m_name;
 		Gtk::TreeModelColumn<ulong>			m_size;
 
@@ -14,7 +14,6 @@
 namespace Grop {
 
 typedef Porg::BasePkg Pkg;
-typedef Porg::File File;
 
 }	// namespace Grop
 
@@ -10,7 +10,6 @@
 #include "porgball.h"
 #include "util.h"
 #include "mainwindow.h"
-#include "porg/file.h"
 #include <gtkmm/table.h>
 #include <gtkmm/stock.h>
 #include <gtkmm/grid.h>
@@ -221,8 +220,9 @@ bool Grop::Porgball::create_porgball()
 	struct stat s;
 
 	for (Pkg::const_iter f(m_pkg.files().begin()); f != m_pkg.files().end(); ++f) {
-		if (!lstat((*f)->name().c_str(), &s))
-			ftmp << (*f)->name() << "\n";
+		string const file(f->name());
+		if (!lstat(file.c_str(), &s))
+			ftmp << file << "\n";
 	}
 
 	if (!ftmp.tellp()) {
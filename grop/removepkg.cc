@@ -10,7 +10,6 @@
 #include "opt.h"
 #include "db.h"
 #include "util.h"
-#include "porg/file.h"
 #include "porg/common.h"
 #include "removepkg.h"
 #include "porg/common.h"
@@ -115,19 +114,19 @@ void RemovePkg::remove()
 
 	for (Pkg::const_iter f(m_pkg.files().begin()); f != m_pkg.files().end(); ++f) {
 		
-		string const& file = (*f)->name();
+		string const file(f->name());
 
 		m_progressbar.set_fraction(cnt++ / m_pkg.nfiles());
 		main_iter();
 
 		// skip excluded
-		if (Porg::in_paths(file, Opt::remove_skip())) {
+		if (Opt::remove_skip_paths().match(file)) {
 			report("'" + file + "': excluded", m_tag_skipped);
 			cnt_excluded++;
 		}
 
 		// skip shared files
-		else if (m_pkg.is_shared(*f, DB::pkgs())) {
+		else if (m_pkg.is_shared(file, DB::pkgs())) {
 			report("'" + file + "': shared", m_tag_skipped);
 			cnt_shared++;
 		}
@@ -135,7 +134,8 @@ void RemovePkg::remove()
 		// remove file
 		else if (!unlink(file.c_str())) {
 			report("Removed '" + file + "'", m_tag_ok);
-			remove_parent_dir(file);
+			if (!m_pkg.dirs_logged())
+				remove_parent_dir(file);
 			cnt_removed++;
 		}
 
@@ -148,6 +148,8 @@ void RemovePkg::remove()
 		}
 	}
 
+	remove_dirs();
+
 	std::ostringstream summary;
 	summary << "\nSummary:\n"
 		<< cnt_removed << " files removed\n"
@@ -169,6 +171,33 @@ void RemovePkg::remove()
 }
 
 
+//
+// Remove the (empty) directories created by the package, bottom-up.
+//
+void RemovePkg::remove_dirs()
+{
+	std::vector<string> const& dirs = m_pkg.dirs();
+
+	for (std::vector<string>::const_reverse_iterator d(dirs.rbegin()); 
+	d != dirs.rend(); ++d) {
+		
+		if (Opt::remove_skip_paths().match(*d))
+			report("'" + *d + "': excluded", m_tag_skipped);
+		
+		else if (!rmdir(d->c_str()))
+			report("Removed directory '" + *d + "'", m_tag_ok);
+		
+		else if (errno != ENOENT && errno != ENOTEMPTY && errno != EEXIST)
+			report("Failed to remove directory '" + *d + "': " + 
+				Glib::strerror(errno), m_tag_error);
+	}
+}
+
+
+//
+// Remove the parent directories of path, while empty (for packages logged
+// without their created directories).
+//
 void RemovePkg::remove_parent_dir(string const& path)
 {
 	string parent = Glib::path_get_dirname(path);
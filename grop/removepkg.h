@@ -33,6 +33,7 @@ class RemovePkg : public Gtk::Dialog
 
 	void on_expander_changed();
 	void remove();
+	void remove_dirs();
 	void remove_parent_dir(std::string const&);
 	void report(std::string const&, Glib::RefPtr<Gtk::TextTag> const&);
 
@@ -0,0 +1,60 @@
+/***********************************************************************
+ * event.h: Format of the records sent by libporg-log to porg.
+ ***********************************************************************
+ * This file is part of the package porg
+ * Copyright (C) 2015 David Ricart
+ * For more information visit http://porg.sourceforge.net
+ ***********************************************************************/
+
+#ifndef PORG_LOG_EVENT_H
+#define PORG_LOG_EVENT_H
+
+#include <stdint.h>
+
+/* 
+ * Operation codes 
+ */
+enum {
+	PORG_OP_OPEN = 1,	/* path opened for writing */
+	PORG_OP_CREAT,		/* path created by creat() */
+	PORG_OP_RENAME,		/* path2 (and its contents) renamed to path */
+	PORG_OP_LINK,		/* path created as a hardlink to path2 */
+	PORG_OP_SYMLINK,	/* path created as a symlink containing path2 */
+	PORG_OP_UNLINK,		/* path removed by unlink() or remove() */
+	PORG_OP_RMDIR,		/* directory path removed */
+	PORG_OP_MKDIR,		/* directory path created */
+	PORG_OP_STATS,		/* counters of libporg-log, as name=value pairs
+						   separated by spaces in path (flags is 1 in the
+						   first record of each report) */
+	PORG_OP_CLOSE		/* path, opened for writing, closed (sent with
+						   PORG_CHECKSUMS only, as soon as possible) */
+};
+
+/*
+ * The channel begins with this header, mapped in memory by every traced 
+ * process, and the records are appended after it.
+ */
+struct porg_channel {
+	uint64_t	gen;		/* incremented before every rename or removal */
+	uint64_t	reserved[7];
+};
+
+/*
+ * Each record consists of this header, followed by path and path2 (not null
+ * terminated), and padded to a multiple of 8 bytes.
+ */
+struct porg_event {
+	uint64_t	time;		/* CLOCK_MONOTONIC, in nanoseconds */
+	uint32_t	size;		/* size of the whole record */
+	uint16_t	op;			/* PORG_OP_* */
+	uint16_t	reserved;
+	int32_t		pid;
+	int32_t		flags;		/* open() flags */
+	uint32_t	path_len;
+	uint32_t	path2_len;
+};
+
+#define PORG_EVENT_SIZE(path_len, path2_len) \
+	((sizeof(struct porg_event) + (path_len) + (path2_len) + 7) & ~(size_t)7)
+
+#endif  /* PORG_LOG_EVENT_H */
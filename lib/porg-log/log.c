@@ -7,34 +7,55 @@
  ***********************************************************************/
 
 #include "config.h"
+#include "event.h"
 #include <dirent.h>
 #include <dlfcn.h>
 #include <fcntl.h>			  
+#include <fnmatch.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdarg.h>
 #include <unistd.h>
+#include <sys/mman.h>
 
 #ifndef RTLD_NEXT
 #	define RTLD_NEXT ((void *) -1l)
 #endif
 
 #define HAVE_64_FUNCS (HAVE_OPEN64 && HAVE_CREAT64 && HAVE_FOPEN64 && HAVE_FREOPEN64)
-#define HAVE_AT_FUNCS (HAVE_OPENAT && HAVE_LINKAT && HAVE_SYMLINKAT && HAVE_RENAMEAT)
+#define HAVE_AT_FUNCS (HAVE_OPENAT && HAVE_LINKAT && HAVE_SYMLINKAT && HAVE_RENAMEAT \
+                       && HAVE_UNLINKAT && HAVE_MKDIRAT)
 
 #define PORG_BUFSIZE  4096
 
+/* size of the per-thread buffer of records, flushed at once */
+#define PORG_LOG_BUFSIZE  (64 * 1024)
+
+#ifndef O_CLOEXEC
+#	define O_CLOEXEC 0
+#endif
+
 static int	(*libc_open)		(const char*, int, ...);
 static int	(*libc_creat)		(const char*, mode_t);
 static int	(*libc_rename)		(const char*, const char*);
 static int	(*libc_link)		(const char*, const char*);
 static int	(*libc_symlink)		(const char*, const char*);
+static int	(*libc_unlink)		(const char*);
+static int	(*libc_rmdir)		(const char*);
+static int	(*libc_remove)		(const char*);
+static int	(*libc_mkdir)		(const char*, mode_t);
 static FILE*(*libc_fopen)		(const char*, const char*);
 static FILE*(*libc_freopen)		(const char*, const char*, FILE*);
+static int	(*libc_fclose)		(FILE*);
 
 #if HAVE_AT_FUNCS
 static int	(*libc_openat)		(int, const char*, int, ...);
 static int	(*libc_renameat)	(int, const char*, int, const char*);
 static int	(*libc_linkat)		(int, const char*, int, const char*, int);
 static int	(*libc_symlinkat)	(const char*, int, const char*);
+static int	(*libc_unlinkat)	(int, const char*, int);
+static int	(*libc_mkdirat)		(int, const char*, mode_t);
 #endif
 
 #if HAVE_64_FUNCS
@@ -52,8 +73,201 @@ static int	(*libc_openat64)	(int, const char*, int, ...);
 static int	(*libc_renameat2)	(int, const char*, int, const char *, unsigned int);
 #endif
 
-static char* porg_tmpfile;
+static int	(*libc_chdir)		(const char*);
+static int	(*libc_fchdir)		(int);
+static int	(*libc_close)		(int);
+static int	(*libc_dup)			(int);
+static int	(*libc_dup2)		(int, int);
+static int	(*libc_closedir)	(DIR*);
+
+#if HAVE_DUP3
+static int	(*libc_dup3)		(int, int, int);
+#endif
+
+static int	(*libc_execve)		(const char*, char* const[], char* const[]);
+static int	(*libc_execv)		(const char*, char* const[]);
+static int	(*libc_execvp)		(const char*, char* const[]);
+static void	(*libc__exit)		(int) __attribute__((noreturn));
+
+#if HAVE_EXECVPE
+static int	(*libc_execvpe)		(const char*, char* const[], char* const[]);
+#endif
+
+#if HAVE_FEXECVE
+static int	(*libc_fexecve)		(int, char* const[], char* const[]);
+#endif
+
+static char* porg_fd_path;
 static char* porg_debug;
+static int porg_initialized;
+static pthread_once_t porg_once = PTHREAD_ONCE_INIT;
+
+/*
+ * Logged paths are written to a channel created by porg (an anonymous memfd
+ * where available) and inherited by the traced processes as descriptor
+ * porg_fd, so that logging involves no path lookups. The channel is opened
+ * with O_APPEND, and each flush of a buffer of records is done with a 
+ * single write(), so that it is appended atomically even when several 
+ * processes log at the same time.
+ * The st_dev/st_ino of the channel are checked before each flush to detect
+ * that the installer closed the descriptor (and perhaps reused it for
+ * another file), in which case the channel is reopened via porg_fd_path.
+ */
+static int		porg_fd = -1;
+static dev_t	porg_fd_dev;
+static ino_t	porg_fd_ino;
+static int		porg_exiting;
+static int		porg_disabled;
+static pid_t	porg_pid;
+static struct porg_channel* porg_shared;	/* header of the channel */
+
+/*
+ * Per-thread state: The buffer of pending records, and scratch buffers for
+ * building paths. They are malloc'ed at the first logged call of each thread,
+ * and linked in porg_threads, so that all the pending records can be flushed
+ * at exit, fork and exec. The structure of an exited thread is reused by
+ * the next new thread.
+ * Locking order is porg_threads_lock, then porg_thread::lock.
+ */
+struct porg_thread {
+	struct porg_thread*	next;
+	volatile int		lock;		/* protects buf and buf_len */
+	int					in_use;		/* owned by a running thread */
+	size_t				buf_len;
+	char				buf[PORG_LOG_BUFSIZE];
+	char				at_path[2][PORG_BUFSIZE];	/* used by *at() handlers */
+	char				abs_path[2][PORG_BUFSIZE];	/* used by porg_log() */
+	char				dir_path[PORG_BUFSIZE];		/* used by porg_add_dirfd() */
+	char				real_path[PORG_BUFSIZE];	/* used by porg_path_logged() */
+	char				last_dir[PORG_BUFSIZE];		/* cache of porg_path_logged() */
+	char				last_real_dir[PORG_BUFSIZE];
+	uint64_t			last_dir_gen;
+};
+
+static struct porg_thread*	porg_threads;
+static volatile int			porg_threads_lock;
+static volatile int			porg_channel_lock;
+static pthread_key_t		porg_thread_key;
+static __thread struct porg_thread* porg_self;
+
+/*
+ * Reentrancy guard: Only the outermost intercepted call of each thread is
+ * logged, so that functions called from within other intercepted functions
+ * (or from libporg-log itself) are not logged twice.
+ */
+static __thread int porg_depth;
+
+/*
+ * Cache of the CWD and of the paths of open directories, so that getting 
+ * absolute paths needs no system calls in the common case.
+ * porg_cwd is invalidated by chdir(), set by fchdir() to the path of a
+ * cached directory, and refreshed with getcwd() when needed.
+ * The paths of the directories opened with open() or openat() and 
+ * O_DIRECTORY, or looked up in /proc/self/fd, are kept by descriptor until 
+ * it is closed or replaced by dup2() or dup3().
+ * chdir()s made internally by libc (e.g. by fts or nftw) are not seen.
+ */
+#define PORG_MAX_DIRFD  1024
+
+static char*			porg_cwd;
+static char*			porg_dirfd[PORG_MAX_DIRFD];
+static unsigned long	porg_paths_gen;		/* changed on every update */
+static volatile int		porg_paths_lock;
+
+/*
+ * With PORG_CHECKSUMS, the logged paths of the descriptors opened for 
+ * writing (also protected by porg_paths_lock). When one of them is closed,
+ * a PORG_OP_CLOSE record is written at once, so that porg can compute the
+ * checksum of the file while it is still in the page cache.
+ */
+static int		porg_checksums;
+static char*	porg_wfd[PORG_MAX_DIRFD];
+
+/*
+ * Paths already logged by this process, not to be logged again: An open
+ * addressing table of 64 bit hashes of the absolute paths (0 meaning empty).
+ * As a logged path may be created again after it is renamed or removed, by
+ * this or by another process, the table is emptied whenever the shared 
+ * counter of renames and removals (porg_shared->gen) changes.
+ */
+#define PORG_SEEN_MIN  1024
+
+static uint64_t*		porg_seen;
+static size_t			porg_seen_size;
+static size_t			porg_seen_cnt;
+static uint64_t			porg_seen_gen;
+static volatile int		porg_seen_lock;
+
+/*
+ * Lists of paths to log and to skip, passed by porg in PORG_INCLUDE and 
+ * PORG_EXCLUDE with the same meaning as in porg (and already normalized:
+ * no empty entries, nor trailing or repeated slashes). Paths without 
+ * wildcards are matched as prefixes, and the others with fnmatch().
+ * Without PORG_INCLUDE, every path is logged.
+ */
+struct porg_paths {
+	size_t	cnt;
+	int		all;		/* contains "/" */
+	char**	path;
+	size_t*	len;		/* 0 for paths with wildcards */
+};
+
+static struct porg_paths	porg_include;
+static struct porg_paths	porg_exclude;
+static int					porg_filter;
+
+/*
+ * Self-instrumentation, enabled by porg with PORG_STATS: Counters of the
+ * intercepted calls per handler, of the events logged or skipped, of the
+ * bytes written to the channel, and of the time spent by libporg-log itself
+ * (not counting the intercepted calls). They are sent to porg in a 
+ * PORG_OP_STATS record at exit and exec, and then reset.
+ */
+enum {
+	PORG_HOOK_OPEN, PORG_HOOK_CREAT, PORG_HOOK_RENAME, PORG_HOOK_LINK,
+	PORG_HOOK_SYMLINK, PORG_HOOK_UNLINK, PORG_HOOK_RMDIR, PORG_HOOK_MKDIR,
+	PORG_HOOK_REMOVE, PORG_HOOK_FOPEN, PORG_HOOK_FREOPEN, PORG_HOOK_OPEN64,
+	PORG_HOOK_CREAT64, PORG_HOOK_FOPEN64, PORG_HOOK_FREOPEN64, PORG_HOOK_OPENAT,
+	PORG_HOOK_RENAMEAT, PORG_HOOK_LINKAT, PORG_HOOK_SYMLINKAT, PORG_HOOK_UNLINKAT,
+	PORG_HOOK_MKDIRAT, PORG_HOOK_OPENAT64, PORG_HOOK_RENAMEAT2, PORG_HOOK_CHDIR,
+	PORG_HOOK_FCHDIR, PORG_HOOK_CLOSE, PORG_HOOK_DUP, PORG_HOOK_DUP2,
+	PORG_HOOK_DUP3, PORG_HOOK_CLOSEDIR, PORG_HOOK_FCLOSE,
+	PORG_NHOOKS
+};
+
+static const char* const porg_hook_names[PORG_NHOOKS] = {
+	"open", "creat", "rename", "link",
+	"symlink", "unlink", "rmdir", "mkdir",
+	"remove", "fopen", "freopen", "open64",
+	"creat64", "fopen64", "freopen64", "openat",
+	"renameat", "linkat", "symlinkat", "unlinkat",
+	"mkdirat", "openat64", "renameat2", "chdir",
+	"fchdir", "close", "dup", "dup2",
+	"dup3", "closedir", "fclose"
+};
+
+enum {
+	PORG_STAT_EVENTS,		/* events logged */
+	PORG_STAT_FILTERED,		/* skipped by PORG_INCLUDE or PORG_EXCLUDE */
+	PORG_STAT_DUPLICATES,	/* skipped as already logged */
+	PORG_STAT_BYTES,		/* written to the channel */
+	PORG_STAT_NSECS,		/* spent by libporg-log */
+	PORG_NSTATS
+};
+
+static const char* const porg_stat_names[PORG_NSTATS] = {
+	"events", "filtered", "duplicates", "bytes", "nsecs"
+};
+
+static int					porg_stats;
+static uint64_t				porg_stat[PORG_NSTATS];
+static uint64_t				porg_hook_calls[PORG_NHOOKS];
+static __thread int			porg_timing;	/* nesting of porg_time_start() */
+static __thread uint64_t	porg_time_begin;
+
+static void porg_flush();
+static void porg_send_stats();
+static void porg_thread_exit(void*);
 
 
 /* Fake declarations of libc's internal __open and __open64 */
@@ -82,39 +296,250 @@ static void porg_die(const char* fmt, ...)
 	va_start(ap, fmt);
 	porg_vprintf(fmt, ap);
 	va_end(ap);
+	porg_disabled = 1;
 	exit(EXIT_FAILURE);
 }
 
 
+static void porg_lock(volatile int* lock)
+{
+	while (__sync_lock_test_and_set(lock, 1))
+		sched_yield();
+}
+
+
+static void porg_unlock(volatile int* lock)
+{
+	__sync_lock_release(lock);
+}
+
+
+static uint64_t porg_now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+static void porg_count(int stat, uint64_t n)
+{
+	if (porg_stats)
+		__sync_fetch_and_add(&porg_stat[stat], n);
+}
+
+
+/*
+ * Measure the time spent by libporg-log between porg_time_start() and 
+ * porg_time_stop(), which may be nested.
+ */
+static void porg_time_start()
+{
+	if (porg_stats && !porg_timing++)
+		porg_time_begin = porg_now();
+}
+
+
+static void porg_time_stop()
+{
+	if (porg_stats && !--porg_timing)
+		porg_count(PORG_STAT_NSECS, porg_now() - porg_time_begin);
+}
+
+
+/*
+ * Get the state of the calling thread, creating it if needed.
+ */
+static struct porg_thread* porg_thread()
+{
+	struct porg_thread* t;
+
+	if (porg_self)
+		return porg_self;
+
+	porg_lock(&porg_threads_lock);
+	
+	for (t = porg_threads; t && t->in_use; t = t->next) ;
+	
+	if (!t) {
+		if (!(t = malloc(sizeof(struct porg_thread))))
+			porg_die("malloc(): %s", strerror(errno));
+		t->lock = 0;
+		t->buf_len = 0;
+		t->last_dir[0] = 0;
+		t->next = porg_threads;
+		porg_threads = t;
+	}
+
+	t->in_use = 1;
+
+	porg_unlock(&porg_threads_lock);
+
+	pthread_setspecific(porg_thread_key, t);
+
+	return porg_self = t;
+}
+
+
+/*
+ * Replace the cached path *slot with a copy of path (or with NULL).
+ * Called with porg_paths_lock held.
+ */
+static void porg_set_path(char** slot, const char* path)
+{
+	free(*slot);
+	*slot = path ? strdup(path) : NULL;
+	porg_paths_gen++;
+}
+
+
+/*
+ * Set the cached path of directory fd (NULL to forget it).
+ */
+static void porg_set_dirfd(int fd, const char* path)
+{
+	if (fd < 0 || fd >= PORG_MAX_DIRFD || (!path && !porg_dirfd[fd]))
+		return;
+
+	porg_lock(&porg_paths_lock);
+	porg_set_path(&porg_dirfd[fd], path);
+	porg_unlock(&porg_paths_lock);
+}
+
+
+/*
+ * Make newfd refer to the cached path of oldfd, after dup*().
+ */
+static void porg_dup_dirfd(int oldfd, int newfd)
+{
+	const char* path;
+	
+	if (newfd < 0 || newfd >= PORG_MAX_DIRFD || newfd == oldfd)
+		return;
+	
+	porg_lock(&porg_paths_lock);
+	path = oldfd >= 0 && oldfd < PORG_MAX_DIRFD ? porg_dirfd[oldfd] : NULL;
+	if (path || porg_dirfd[newfd])
+		porg_set_path(&porg_dirfd[newfd], path);
+	porg_unlock(&porg_paths_lock);
+}
+
+
+/*
+ * Remember the path just logged by this thread as the path of descriptor fd,
+ * opened for writing.
+ */
+static void porg_watch_fd(int fd)
+{
+	char* path;
+
+	if (!porg_checksums || fd < 0 || fd >= PORG_MAX_DIRFD)
+		return;
+
+	path = strdup(porg_thread()->abs_path[0]);
+
+	porg_lock(&porg_paths_lock);
+	free(porg_wfd[fd]);
+	porg_wfd[fd] = path;
+	porg_unlock(&porg_paths_lock);
+}
+
+
+/*
+ * Forget the descriptor fd, opened for writing, and return its path (to be
+ * freed by the caller), or NULL if not watched.
+ */
+static char* porg_unwatch_fd(int fd)
+{
+	char* path;
+
+	if (!porg_checksums || fd < 0 || fd >= PORG_MAX_DIRFD || !porg_wfd[fd])
+		return NULL;
+
+	porg_lock(&porg_paths_lock);
+	path = porg_wfd[fd];
+	porg_wfd[fd] = NULL;
+	porg_unlock(&porg_paths_lock);
+
+	return path;
+}
+
+
+/*
+ * Copy into buf the path of the directory referred to by fd, or of the CWD
+ * if fd is negative. On a cache miss, the path is got with getcwd() or
+ * readlink("/proc/self/fd/N"), and cached unless the cache has changed in 
+ * the meantime. Return 0 if the path can't be got.
+ */
+static int porg_get_dir(int fd, char* buf)
+{
+	char proc_path[32];
+	char** slot;
+	unsigned long gen;
+	ssize_t len;
+	int found = 0;
+
+	if (fd < 0)
+		slot = &porg_cwd;
+	else if (fd < PORG_MAX_DIRFD)
+		slot = &porg_dirfd[fd];
+	else
+		slot = NULL;
+
+	porg_lock(&porg_paths_lock);
+	if (slot && *slot) {
+		strncpy(buf, *slot, PORG_BUFSIZE - 1);
+		buf[PORG_BUFSIZE - 1] = 0;
+		found = 1;
+	}
+	gen = porg_paths_gen;
+	porg_unlock(&porg_paths_lock);
+
+	if (found)
+		return 1;
+
+	if (fd < 0) {
+		if (!getcwd(buf, PORG_BUFSIZE))
+			return 0;
+	}
+	else {
+		snprintf(proc_path, sizeof(proc_path), "/proc/self/fd/%d", fd);
+		if ((len = readlink(proc_path, buf, PORG_BUFSIZE - 1)) <= 0)
+			return 0;
+		buf[len] = 0;
+		if (buf[0] != '/')
+			return 0;
+	}
+
+	if (slot) {
+		porg_lock(&porg_paths_lock);
+		if (gen == porg_paths_gen)
+			porg_set_path(slot, buf);
+		porg_unlock(&porg_paths_lock);
+	}
+	
+	return 1;
+}
+
+
 /*
  * Get the absolute path, referring relative paths to the CWD, or to directory
  * referred to by file descriptor fd, if non negative.
  */
 static void porg_get_absolute_path(int fd, const char* path, char* abs_path)
 {
-	static char cwd[PORG_BUFSIZE], aux[PORG_BUFSIZE];
 	int old_errno = errno;
 
-	/* already absolute (or can't get CWD) */
-	if (path[0] == '/' || !getcwd(cwd, PORG_BUFSIZE))
+	/* already absolute (or can't get the directory) */
+	if (path[0] == '/' || !porg_get_dir(fd, abs_path))
 		strncpy(abs_path, path, PORG_BUFSIZE - 1);
 
-	/* relative to CWD */
-	else if (fd < 0) {
-		strncpy(abs_path, cwd, PORG_BUFSIZE - 1);
-		abs_path[PORG_BUFSIZE - 1] = 0;
+	/* relative to CWD or to directory fd */
+	else {
 		strncat(abs_path, "/", PORG_BUFSIZE - strlen(abs_path) - 1);
 		strncat(abs_path, path, PORG_BUFSIZE - strlen(abs_path) - 1);
 	}
-	/* relative to directory fd */
-	else if (fchdir(fd) == 0 && getcwd(aux, PORG_BUFSIZE) && chdir(cwd) == 0) {
-		strncpy(abs_path, aux, PORG_BUFSIZE - 1);
-		abs_path[PORG_BUFSIZE - 1] = 0;
-		strncat(abs_path, "/", PORG_BUFSIZE - strlen(abs_path) - 1);
-		strncat(abs_path, path, PORG_BUFSIZE - strlen(abs_path) - 1);
-	}
-	else
-		strncpy(abs_path, path, PORG_BUFSIZE - 1);
 
 	abs_path[PORG_BUFSIZE - 1] = 0;
 
@@ -122,6 +547,242 @@ static void porg_get_absolute_path(int fd, const char* path, char* abs_path)
 }
 
 
+/*
+ * Cache the path of the directory fd, just opened as path relative to dirfd.
+ */
+static void porg_add_dirfd(int fd, int dirfd, const char* path)
+{
+	char* dir_path;
+
+	if (fd < 0 || fd >= PORG_MAX_DIRFD)
+		return;
+
+	porg_time_start();
+
+	dir_path = porg_thread()->dir_path;
+	porg_get_absolute_path(dirfd, path, dir_path);
+	
+	if (dir_path[0] == '/')
+		porg_set_dirfd(fd, dir_path);
+
+	porg_time_stop();
+}
+
+
+/*
+ * FNV-1a hash of a string (never 0).
+ */
+static uint64_t porg_hash(const char* s)
+{
+	uint64_t h = 14695981039346656037UL;
+
+	for ( ; *s; s++) {
+		h ^= (unsigned char)*s;
+		h *= 1099511628211UL;
+	}
+
+	return h ? h : 1;
+}
+
+
+/*
+ * Insert h into the table t of porg_seen_size entries. Return 0 if it was
+ * already there.
+ */
+static int porg_seen_insert(uint64_t* t, uint64_t h)
+{
+	size_t i;
+
+	for (i = h & (porg_seen_size - 1); t[i]; i = (i + 1) & (porg_seen_size - 1)) {
+		if (t[i] == h)
+			return 0;
+	}
+
+	t[i] = h;
+	return 1;
+}
+
+
+/*
+ * Check whether path has already been logged by this process, and mark it
+ * as logged otherwise.
+ */
+static int porg_seen_path(const char* path)
+{
+	uint64_t *t, gen, h = porg_hash(path);
+	size_t i, old_size;
+	int ret = 0;
+
+	if (!porg_shared)
+		return 0;
+
+	porg_lock(&porg_seen_lock);
+
+	gen = *(volatile uint64_t*)&porg_shared->gen;
+
+	if (gen != porg_seen_gen) {
+		if (porg_seen)
+			memset(porg_seen, 0, porg_seen_size * sizeof(uint64_t));
+		porg_seen_cnt = 0;
+		porg_seen_gen = gen;
+	}
+
+	/* keep the load factor under 1/2 */
+	if ((porg_seen_cnt + 1) * 2 > porg_seen_size) {
+		old_size = porg_seen_size;
+		porg_seen_size = old_size ? old_size * 2 : PORG_SEEN_MIN;
+		if (!(t = calloc(porg_seen_size, sizeof(uint64_t)))) {
+			porg_seen_size = old_size;
+			goto goto_end;
+		}
+		for (i = 0; i < old_size; i++) {
+			if (porg_seen[i])
+				porg_seen_insert(t, porg_seen[i]);
+		}
+		free(porg_seen);
+		porg_seen = t;
+	}
+
+	if (porg_seen_insert(porg_seen, h))
+		porg_seen_cnt++;
+	else
+		ret = 1;
+
+goto_end:
+	porg_unlock(&porg_seen_lock);
+	return ret;
+}
+
+
+/*
+ * Called before every rename or removal, to make all the traced processes 
+ * forget the paths they have already logged.
+ */
+static void porg_forget_paths()
+{
+	if (porg_shared)
+		__sync_fetch_and_add(&porg_shared->gen, 1);
+}
+
+
+/*
+ * Split the colon separated list str into t.
+ */
+static void porg_paths_init(struct porg_paths* t, const char* str)
+{
+	char *buf, *p;
+	size_t n;
+
+	if (!(buf = strdup(str)))
+		porg_die("strdup(): %s", strerror(errno));
+
+	for (n = 1, p = buf; *p; p++)
+		n += (*p == ':');
+	
+	t->path = malloc(n * sizeof(char*));
+	t->len = malloc(n * sizeof(size_t));
+	if (!t->path || !t->len)
+		porg_die("malloc(): %s", strerror(errno));
+
+	for (p = strtok(buf, ":"); p; p = strtok(NULL, ":")) {
+		if (!strcmp(p, "/"))
+			t->all = 1;
+		t->path[t->cnt] = p;
+		t->len[t->cnt++] = strpbrk(p, "*?[") ? 0 : strlen(p);
+	}
+}
+
+
+/*
+ * Like porg's in_paths(): Whether path (of length len, without trailing 
+ * slashes) is in t.
+ */
+static int porg_in_paths(const struct porg_paths* t, const char* path, size_t len)
+{
+	size_t i;
+
+	if (t->all)
+		return 1;
+
+	for (i = 0; i < t->cnt; i++) {
+		if (t->len[i]) {
+			if (len >= t->len[i] && !memcmp(path, t->path[i], t->len[i])
+			&& (len == t->len[i] || path[t->len[i]] == '/'))
+				return 1;
+		}
+		else if (!fnmatch(t->path[i], path, 0))
+			return 1;
+	}
+
+	return 0;
+}
+
+
+static int porg_path_matches(const char* path)
+{
+	size_t len = strlen(path);
+
+	while (len > 1 && path[len - 1] == '/')
+		len--;
+
+	/* fnmatch() needs the path without the trailing slashes */
+	if (path[len]) {
+		char* buf = porg_thread()->real_path;
+		memmove(buf, path, len);
+		buf[len] = 0;
+		path = buf;
+	}
+
+	return !porg_in_paths(&porg_exclude, path, len) 
+		&& porg_in_paths(&porg_include, path, len);
+}
+
+
+/*
+ * Whether the absolute path is to be logged, according to PORG_INCLUDE and
+ * PORG_EXCLUDE. porg matches the paths after resolving the symlinks in their
+ * directories, so a path that does not match is checked again with its
+ * directory resolved with realpath(). The last directory resolved by each
+ * thread is cached until the next rename or removal.
+ */
+static int porg_path_logged(const char* path)
+{
+	struct porg_thread* t;
+	const char* base;
+	uint64_t gen;
+	size_t dir_len;
+
+	if (!porg_filter || path[0] != '/' || porg_path_matches(path))
+		return 1;
+
+	t = porg_thread();
+	gen = porg_shared ? *(volatile uint64_t*)&porg_shared->gen : 0;
+	base = strrchr(path, '/');
+	dir_len = base - path;
+	
+	if (!dir_len)
+		return 0;
+
+	if (gen != t->last_dir_gen || strncmp(t->last_dir, path, dir_len)
+	|| t->last_dir[dir_len]) {
+		memcpy(t->last_dir, path, dir_len);
+		t->last_dir[dir_len] = 0;
+		t->last_dir_gen = gen;
+		if (!realpath(t->last_dir, t->last_real_dir))
+			strcpy(t->last_real_dir, t->last_dir);
+	}
+
+	if (!strcmp(t->last_real_dir, t->last_dir)
+	|| strlen(t->last_real_dir) + strlen(base) >= PORG_BUFSIZE)
+		return 0;
+
+	strcpy(t->real_path, t->last_real_dir);
+	strcat(t->real_path, base);
+
+	return porg_path_matches(t->real_path);
+}
+
+
 static void* porg_dlsym(const char* symbol)
 {
 	void* ret;
@@ -138,17 +799,194 @@ static void* porg_dlsym(const char* symbol)
 }
 
 
-static void porg_init()
+/*
+ * Make sure porg_fd refers to the channel, reopening it if needed.
+ */
+static void porg_open_channel()
+{
+	struct stat st;
+
+	if (!fstat(porg_fd, &st)
+	&& st.st_dev == porg_fd_dev && st.st_ino == porg_fd_ino)
+		return;
+
+	/* Closed by the installer. Don't close porg_fd here, as it may have 
+	   been reused for another file. */
+
+	if ((porg_fd = libc_open(porg_fd_path, O_WRONLY | O_APPEND | O_CLOEXEC)) < 0)
+		porg_die("open(\"%s\"): %s", porg_fd_path, strerror(errno));
+
+	if (fstat(porg_fd, &st) < 0)
+		porg_die("fstat(%d): %s", porg_fd, strerror(errno));
+	
+	else if (st.st_dev != porg_fd_dev || st.st_ino != porg_fd_ino)
+		porg_die("%s: not a porg channel", porg_fd_path);
+}
+
+
+/*
+ * Write the pending records of thread t (locked by the caller) to the channel.
+ */
+static void porg_write(struct porg_thread* t)
 {
-	if (porg_tmpfile) /* already init'ed */
+	size_t done;
+	ssize_t cnt;
+	int old_errno = errno;
+
+	if (!t->buf_len)
 		return;
 
+	porg_time_start();
+
+	porg_lock(&porg_channel_lock);
+	porg_open_channel();
+	porg_unlock(&porg_channel_lock);
+
+	for (done = 0; done < t->buf_len; done += cnt) {
+		if ((cnt = write(porg_fd, t->buf + done, t->buf_len - done)) < 0) {
+			if (errno == EINTR)
+				cnt = 0;
+			else
+				porg_die("write(%d): %s", porg_fd, strerror(errno));
+		}
+	}
+
+	porg_count(PORG_STAT_BYTES, t->buf_len);
+	t->buf_len = 0;
+
+	porg_time_stop();
+	errno = old_errno;
+}
+
+
+/*
+ * Write the pending records of all threads to the channel.
+ */
+static void porg_flush()
+{
+	struct porg_thread* t;
+
+	porg_lock(&porg_threads_lock);
+
+	for (t = porg_threads; t; t = t->next) {
+		porg_lock(&t->lock);
+		porg_write(t);
+		porg_unlock(&t->lock);
+	}
+
+	porg_unlock(&porg_threads_lock);
+}
+
+
+/*
+ * Before fork(), write all the pending records, so that the child does not
+ * log them again, and keep all the locks held until the fork is done, so
+ * that the child does not inherit any lock in use by another thread.
+ */
+static void porg_atfork_prepare()
+{
+	struct porg_thread* t;
+
+	porg_lock(&porg_threads_lock);
+	
+	for (t = porg_threads; t; t = t->next) {
+		porg_lock(&t->lock);
+		porg_write(t);
+	}
+
+	porg_lock(&porg_paths_lock);
+	porg_lock(&porg_seen_lock);
+}
+
+
+static void porg_atfork_parent()
+{
+	struct porg_thread* t;
+
+	porg_unlock(&porg_seen_lock);
+	porg_unlock(&porg_paths_lock);
+
+	for (t = porg_threads; t; t = t->next)
+		porg_unlock(&t->lock);
+	
+	porg_unlock(&porg_threads_lock);
+}
+
+
+/*
+ * Only the forking thread exists in the child.
+ */
+static void porg_atfork_child()
+{
+	struct porg_thread* t;
+
+	porg_unlock(&porg_seen_lock);
+	porg_unlock(&porg_paths_lock);
+
+	for (t = porg_threads; t; t = t->next) {
+		t->in_use = (t == porg_self);
+		porg_unlock(&t->lock);
+	}
+	
+	porg_unlock(&porg_threads_lock);
+
+	porg_pid = getpid();
+
+	/* the counters of the parent are reported by the parent */
+	memset(porg_stat, 0, sizeof(porg_stat));
+	memset(porg_hook_calls, 0, sizeof(porg_hook_calls));
+}
+
+
+/*
+ * Destructor of porg_thread_key: Flush the records of an exiting thread,
+ * and release its state to be reused.
+ */
+static void porg_thread_exit(void* arg)
+{
+	struct porg_thread* t = arg;
+	
+	porg_lock(&porg_threads_lock);
+	porg_lock(&t->lock);
+	
+	porg_write(t);
+	t->in_use = 0;
+	
+	porg_unlock(&t->lock);
+	porg_unlock(&porg_threads_lock);
+
+	porg_self = NULL;
+}
+
+
+static void porg_do_init()
+{
+	char* fd_str;
+	unsigned long dev, ino;
+	struct stat st;
+	void* p;
+
 	/* read the environment */
 	
-	if (!(porg_tmpfile = getenv("PORG_TMPFILE")))
-		porg_die("variable PORG_TMPFILE undefined");
-		
 	porg_debug = getenv("PORG_DEBUG");
+	porg_stats = getenv("PORG_STATS") != NULL;
+	porg_checksums = getenv("PORG_CHECKSUMS") != NULL;
+
+	if (!(fd_str = getenv("PORG_FD"))
+	|| sscanf(fd_str, "%d:%lu:%lu", &porg_fd, &dev, &ino) != 3)
+		porg_die("variable PORG_FD undefined or invalid");
+	
+	porg_fd_dev = dev;
+	porg_fd_ino = ino;
+
+	if (!(porg_fd_path = getenv("PORG_FD_PATH")))
+		porg_die("variable PORG_FD_PATH undefined");
+
+	if (getenv("PORG_INCLUDE")) {
+		porg_paths_init(&porg_include, getenv("PORG_INCLUDE"));
+		porg_paths_init(&porg_exclude, getenv("PORG_EXCLUDE") ? getenv("PORG_EXCLUDE") : "");
+		porg_filter = 1;
+	}
 	
 	/* handle system calls */
 	
@@ -157,8 +995,13 @@ static void porg_init()
 	libc_rename 	= porg_dlsym("rename");
 	libc_link 		= porg_dlsym("link");
 	libc_symlink 	= porg_dlsym("symlink");
+	libc_unlink 	= porg_dlsym("unlink");
+	libc_rmdir 		= porg_dlsym("rmdir");
+	libc_remove 	= porg_dlsym("remove");
+	libc_mkdir 		= porg_dlsym("mkdir");
 	libc_fopen 		= porg_dlsym("fopen");
 	libc_freopen 	= porg_dlsym("freopen");
+	libc_fclose 	= porg_dlsym("fclose");
 
 #if HAVE_64_FUNCS
 	libc_open64 	= porg_dlsym("open64");
@@ -172,6 +1015,8 @@ static void porg_init()
 	libc_renameat	= porg_dlsym("renameat");
 	libc_linkat		= porg_dlsym("linkat");
 	libc_symlinkat	= porg_dlsym("symlinkat");
+	libc_unlinkat	= porg_dlsym("unlinkat");
+	libc_mkdirat	= porg_dlsym("mkdirat");
 #endif
 
 #if HAVE_OPENAT64
@@ -181,23 +1026,206 @@ static void porg_init()
 #if HAVE_RENAMEAT2
 	libc_renameat2 	= porg_dlsym("renameat2");
 #endif
+
+	libc_chdir		= porg_dlsym("chdir");
+	libc_fchdir		= porg_dlsym("fchdir");
+	libc_close		= porg_dlsym("close");
+	libc_dup		= porg_dlsym("dup");
+	libc_dup2		= porg_dlsym("dup2");
+	libc_closedir	= porg_dlsym("closedir");
+
+#if HAVE_DUP3
+	libc_dup3		= porg_dlsym("dup3");
+#endif
+
+	libc_execve		= porg_dlsym("execve");
+	libc_execv		= porg_dlsym("execv");
+	libc_execvp		= porg_dlsym("execvp");
+	libc__exit		= porg_dlsym("_exit");
+
+#if HAVE_EXECVPE
+	libc_execvpe	= porg_dlsym("execvpe");
+#endif
+
+#if HAVE_FEXECVE
+	libc_fexecve	= porg_dlsym("fexecve");
+#endif
+
+	porg_pid = getpid();
+
+	/* map the header of the channel, unless porg_fd was closed by the
+	   installer (then paths are not checked for duplicates) */
+
+	if (!fstat(porg_fd, &st) && st.st_dev == porg_fd_dev && st.st_ino == porg_fd_ino
+	&& (p = mmap(NULL, sizeof(struct porg_channel), PROT_READ | PROT_WRITE,
+	             MAP_SHARED, porg_fd, 0)) != MAP_FAILED)
+		porg_shared = p;
+
+	if ((errno = pthread_key_create(&porg_thread_key, porg_thread_exit)))
+		porg_die("pthread_key_create(): %s", strerror(errno));
+
+	/* don't let the child of a fork inherit (and log twice) pending paths */
+	pthread_atfork(porg_atfork_prepare, porg_atfork_parent, porg_atfork_child);
+
+	porg_initialized = 1;
+}
+
+
+static void porg_init()
+{
+	pthread_once(&porg_once, porg_do_init);
+}
+
+
+/*
+ * Count an intercepted call.
+ */
+static void porg_hook(int hook)
+{
+	porg_init();
+
+	if (porg_stats)
+		__sync_fetch_and_add(&porg_hook_calls[hook], 1);
 }
 
 
 /*
- * Log a filename to the tmp file, and print a debug message to stderr if 
- * debugging is enabled.
+ * Called at the beginning and at the end of every handler.
  */
-static void porg_log(const char* path, const char* fmt, ...)
+static void porg_enter(int hook)
 {
-	static char abs_path[PORG_BUFSIZE];
+	porg_hook(hook);
+	porg_depth++;
+}
+
+
+static void porg_leave()
+{
+	porg_depth--;
+}
+
+
+
+
+/*
+ * Flush the pending records when the process exits. Files written after this
+ * point (e.g. by atexit handlers run later) are written unbuffered.
+ */
+static void porg_fini() __attribute__((destructor));
+
+static void porg_fini()
+{
+	if (!porg_initialized || porg_disabled)
+		return;
+
+	porg_exiting = 1;
+	__sync_synchronize();
+	porg_send_stats();
+	porg_flush();
+}
+
+
+/*
+ * Convert a fopen() mode into open() flags.
+ */
+static int porg_fopen_flags(const char* mode)
+{
+	int flags = strchr(mode, '+') ? O_RDWR : O_WRONLY;
+
+	if (mode[0] == 'w')
+		flags |= O_CREAT | O_TRUNC;
+	else if (mode[0] == 'a')
+		flags |= O_CREAT | O_APPEND;
+
+	return flags;
+}
+
+
+/*
+ * Append a record to the buffer of thread t.
+ */
+static void porg_append(struct porg_thread* t, int op, int flags, 
+                        const char* path, const char* path2)
+{
+	struct porg_event ev;
+	char* rec;
+
+	ev.time = porg_now();
+	ev.op = op;
+	ev.reserved = 0;
+	ev.pid = porg_pid;
+	ev.flags = flags;
+	ev.path_len = strlen(path);
+	ev.path2_len = strlen(path2);
+	ev.size = PORG_EVENT_SIZE(ev.path_len, ev.path2_len);
+
+	porg_lock(&t->lock);
+
+	if (t->buf_len + ev.size > PORG_LOG_BUFSIZE)
+		porg_write(t);
+	
+	rec = t->buf + t->buf_len;
+	memcpy(rec, &ev, sizeof(ev));
+	memcpy(rec + sizeof(ev), path, ev.path_len);
+	memcpy(rec + sizeof(ev) + ev.path_len, path2, ev.path2_len);
+	memset(rec + sizeof(ev) + ev.path_len + ev.path2_len, 0,
+		ev.size - sizeof(ev) - ev.path_len - ev.path2_len);
+	t->buf_len += ev.size;
+
+	if (porg_exiting)
+		porg_write(t);
+	
+	porg_unlock(&t->lock);
+}
+
+
+/*
+ * Log an event to the channel, and print a debug message to stderr if 
+ * debugging is enabled. path2 is the source of a rename or a hardlink,
+ * the contents of a symlink, or NULL.
+ * Return whether path is logged (now or before), leaving its absolute path
+ * in the abs_path[0] buffer of the thread.
+ */
+static int porg_log(int op, int flags, const char* path, const char* path2,
+                    const char* fmt, ...)
+{
+	struct porg_thread* t;
 	va_list a;
-	int fd, len, old_errno = errno;
+	char *abs_path, *abs_path2;
+	int old_errno = errno;
+	int ret = 0;
 	
-	if (!strncmp(path, "/dev/", 5) || !strncmp(path, "/proc/", 6))
-		return;
+	if (porg_depth > 1 || porg_disabled)
+		return 0;
+
+	else if (!strncmp(path, "/dev/", 5) || !strncmp(path, "/proc/", 6))
+		return 0;
 
 	porg_init();
+	porg_time_start();
+
+	t = porg_thread();
+	abs_path = t->abs_path[0];
+	abs_path2 = t->abs_path[1];
+
+	porg_get_absolute_path(-1, path, abs_path);
+
+	if (!path2)
+		abs_path2[0] = 0;
+	else if (op == PORG_OP_SYMLINK) {
+		strncpy(abs_path2, path2, PORG_BUFSIZE - 1);
+		abs_path2[PORG_BUFSIZE - 1] = 0;
+	}
+	else
+		porg_get_absolute_path(-1, path2, abs_path2);
+
+	/* skip the paths that porg would discard (a rename or a link is kept
+	   if any of its paths is logged, as porg needs the source) */
+	if (!porg_path_logged(abs_path) && (op == PORG_OP_SYMLINK || !abs_path2[0]
+	|| !porg_path_logged(abs_path2))) {
+		porg_count(PORG_STAT_FILTERED, 1);
+		goto goto_end;
+	}
 
 	if (porg_debug) {
 		va_start(a, fmt);
@@ -205,74 +1233,103 @@ static void porg_log(const char* path, const char* fmt, ...)
 		va_end(a);
 	}
 
-	/* write path to tmp file to be read by porg */
+	ret = 1;
 
-	if ((fd = libc_open(porg_tmpfile, O_WRONLY | O_CREAT | O_APPEND, 0644)) < 0)
-		porg_die("open(\"%s\"): %s", porg_tmpfile, strerror(errno));
-	
-	porg_get_absolute_path(-1, path, abs_path);
-	strncat(abs_path, "\n", PORG_BUFSIZE - strlen(abs_path) - 1);
-	len = strlen(abs_path);
+	/* don't log again the paths opened repeatedly */
+	if ((op == PORG_OP_OPEN || op == PORG_OP_CREAT) && porg_seen_path(abs_path)) {
+		porg_count(PORG_STAT_DUPLICATES, 1);
+		goto goto_end;
+	}
+
+	/* buffer the record, to be written to the channel read by porg */
+	porg_append(t, op, flags, abs_path, abs_path2);
+	porg_count(PORG_STAT_EVENTS, 1);
+
+goto_end:
+	porg_time_stop();
+	errno = old_errno;
+	return ret;
+}
+
+
+/*
+ * Tell porg that path, opened for writing, has been closed, flushing the
+ * pending records of the thread so that porg gets it without delay.
+ */
+static void porg_log_close(const char* path)
+{
+	struct porg_thread* t;
+	int old_errno = errno;
+
+	if (porg_disabled)
+		return;
+
+	porg_time_start();
 	
-	if (write(fd, abs_path, len) != len)
-		porg_die("%s: write(): %s", porg_tmpfile, strerror(errno));
-		
-	if (close(fd) < 0)
-		porg_die("close(%d): %s", fd, strerror(errno));
+	t = porg_thread();
+	porg_append(t, PORG_OP_CLOSE, 0, path, "");
 	
+	porg_lock(&t->lock);
+	porg_write(t);
+	porg_unlock(&t->lock);
+
+	porg_time_stop();
 	errno = old_errno;
 }
 
 
-/* 
- * Handle renaming of directories 
+/*
+ * Send the counters to porg in PORG_OP_STATS records, as a list of 
+ * name=value pairs, and reset them. The list is split in several records if
+ * it does not fit in one, the first one flagged, and each counter is reset
+ * only once its record is queued.
  */
-static void porg_log_rename(const char* oldpath, const char* newpath)
+static void porg_send_stats()
 {
-	char oldbuf[PORG_BUFSIZE], newbuf[PORG_BUFSIZE];
-	struct stat st;
-	DIR* dir;
-	struct dirent* e;
-	size_t oldlen, newlen;
-	int old_errno = errno;
+	char buf[PORG_BUFSIZE], pair[128];
+	uint64_t sent[PORG_NSTATS + PORG_NHOOKS];
+	size_t len = 0, cnt = 0;
+	int i, j, first = 0, flags = 1;
 
-	/* The newpath file doesn't exist */
-	if (lstat(newpath, &st) < 0) 
-		goto goto_end;
+	if (!porg_stats || porg_disabled)
+		return;
 
-	else if (!S_ISDIR(st.st_mode)) {
-		/* newpath is not a directory, we're done */
-		porg_log(newpath, "rename(\"%s\", \"%s\")", oldpath, newpath);
-		goto goto_end;
-	}
+	for (i = 0; i <= PORG_NSTATS + PORG_NHOOKS; i++) {
 
-	/* Make sure we have enough space for the following slashes */
-	oldlen = strlen(oldpath);
-	newlen = strlen(newpath);
-	if (oldlen + 3 > PORG_BUFSIZE || newlen + 3 > PORG_BUFSIZE)
-		goto goto_end;
+		if (i < PORG_NSTATS + PORG_NHOOKS) {
+			sent[i] = i < PORG_NSTATS ? porg_stat[i] : porg_hook_calls[i - PORG_NSTATS];
+			if (!sent[i] && i >= PORG_NSTATS)
+				continue;
+			cnt = snprintf(pair, sizeof(pair), "%s=%" PRIu64, i < PORG_NSTATS
+				? porg_stat_names[i] : porg_hook_names[i - PORG_NSTATS], sent[i]);
+		}
 
-	strcpy(oldbuf, oldpath);
-	strcpy(newbuf, newpath);
-	oldbuf[oldlen] = newbuf[newlen] = '/';
-	oldbuf[++oldlen] = newbuf[++newlen] = 0;
+		/* send the pairs so far, at the end or if this one does not fit */
 
-	if (!(dir = opendir(newbuf)))
-		goto goto_end;
+		if (len && (i == PORG_NSTATS + PORG_NHOOKS || len + 1 + cnt >= sizeof(buf))) {
+			porg_append(porg_thread(), PORG_OP_STATS, flags, buf, "");
+			for (j = first; j < i; j++)
+				__sync_fetch_and_sub(j < PORG_NSTATS ? &porg_stat[j] 
+					: &porg_hook_calls[j - PORG_NSTATS], sent[j]);
+			len = 0;
+			first = i;
+			flags = 0;
+		}
 
-	while ((e = readdir(dir))) {
-		if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, ".."))
-			continue;
-		strncat(oldbuf, e->d_name, PORG_BUFSIZE - oldlen - 1);
-		strncat(newbuf, e->d_name, PORG_BUFSIZE - newlen - 1);
-		porg_log_rename(oldbuf, newbuf);
-		oldbuf[oldlen] = newbuf[newlen] = 0;
+		if (i < PORG_NSTATS + PORG_NHOOKS)
+			len += snprintf(buf + len, sizeof(buf) - len, "%s%s", len ? " " : "", pair);
 	}
+}
 
-	closedir(dir);
 
-goto_end: 
-	errno = old_errno;
+/* 
+ * Log a rename. The contents of a renamed directory are added by porg after
+ * the command finishes, rather than walked here.
+ */
+static void porg_log_rename(const char* oldpath, const char* newpath)
+{
+	porg_log(PORG_OP_RENAME, 0, newpath, oldpath,
+		"rename(\"%s\", \"%s\")", oldpath, newpath);
 }
 
 
@@ -288,10 +1345,10 @@ int open(const char* path, int flags, ...)
 
 	/* this fixes a bug when the installer program calls jemalloc 
 	   (thanks Masahiro Kasahara) */
-	if (!porg_tmpfile && path && !strncmp(path, "/proc/", 6))
+	if (!porg_initialized && path && !strncmp(path, "/proc/", 6))
 		return __open(path, flags);
 
-	porg_init();
+	porg_enter(PORG_HOOK_OPEN);
 	
 	va_start(a, flags);
 	mode = va_arg(a, int);
@@ -299,10 +1356,15 @@ int open(const char* path, int flags, ...)
 	
 	if ((ret = libc_open(path, flags, mode)) != -1) {
 		accmode = flags & O_ACCMODE;
-		if (accmode == O_WRONLY || accmode == O_RDWR)
-			porg_log(path, "open(\"%s\")", path);
+		if (accmode == O_WRONLY || accmode == O_RDWR) {
+			if (porg_log(PORG_OP_OPEN, flags, path, NULL, "open(\"%s\")", path))
+				porg_watch_fd(ret);
+		}
+		else if (flags & O_DIRECTORY)
+			porg_add_dirfd(ret, -1, path);
 	}
 
+	porg_leave();
 	return ret;
 }
 
@@ -311,11 +1373,14 @@ int creat(const char* path, mode_t mode)
 {
 	int ret;
 	
-	porg_init();
+	porg_enter(PORG_HOOK_CREAT);
 	
-	if ((ret = libc_creat(path, mode)) != -1)
-		porg_log(path, "creat(\"%s\", 0%o)", path, (int)mode);
+	if ((ret = libc_creat(path, mode)) != -1
+	&& porg_log(PORG_OP_CREAT, O_CREAT | O_WRONLY | O_TRUNC, path, NULL,
+			"creat(\"%s\", 0%o)", path, (int)mode))
+		porg_watch_fd(ret);
 	
+	porg_leave();
 	return ret;
 }
 
@@ -324,11 +1389,13 @@ int rename(const char* oldpath, const char* newpath)
 {
 	int ret;
 	
-	porg_init();
+	porg_enter(PORG_HOOK_RENAME);
+	porg_forget_paths();
 	
 	if ((ret = libc_rename(oldpath, newpath)) != -1)
 		porg_log_rename(oldpath, newpath);
 
+	porg_leave();
 	return ret;
 }
 
@@ -337,11 +1404,13 @@ int link(const char* oldpath, const char* newpath)
 {
 	int ret;
 	
-	porg_init();
+	porg_enter(PORG_HOOK_LINK);
 	
 	if ((ret = libc_link(oldpath, newpath)) != -1)
-		porg_log(newpath, "link(\"%s\", \"%s\")", oldpath, newpath);
+		porg_log(PORG_OP_LINK, 0, newpath, oldpath,
+			"link(\"%s\", \"%s\")", oldpath, newpath);
 	
+	porg_leave();
 	return ret;
 }
 
@@ -350,11 +1419,73 @@ int symlink(const char* oldpath, const char* newpath)
 {
 	int ret;
 	
-	porg_init();
+	porg_enter(PORG_HOOK_SYMLINK);
 	
 	if ((ret = libc_symlink(oldpath, newpath)) != -1)
-		porg_log(newpath, "symlink(\"%s\", \"%s\")", oldpath, newpath);
+		porg_log(PORG_OP_SYMLINK, 0, newpath, oldpath,
+			"symlink(\"%s\", \"%s\")", oldpath, newpath);
+	
+	porg_leave();
+	return ret;
+}
+
+
+int unlink(const char* path)
+{
+	int ret;
+	
+	porg_enter(PORG_HOOK_UNLINK);
+	porg_forget_paths();
+	
+	if ((ret = libc_unlink(path)) != -1)
+		porg_log(PORG_OP_UNLINK, 0, path, NULL, "unlink(\"%s\")", path);
+	
+	porg_leave();
+	return ret;
+}
+
+
+int rmdir(const char* path)
+{
+	int ret;
+	
+	porg_enter(PORG_HOOK_RMDIR);
+	porg_forget_paths();
+	
+	if ((ret = libc_rmdir(path)) != -1)
+		porg_log(PORG_OP_RMDIR, 0, path, NULL, "rmdir(\"%s\")", path);
 	
+	porg_leave();
+	return ret;
+}
+
+
+int mkdir(const char* path, mode_t mode)
+{
+	int ret;
+	
+	porg_enter(PORG_HOOK_MKDIR);
+	
+	if ((ret = libc_mkdir(path, mode)) != -1)
+		porg_log(PORG_OP_MKDIR, 0, path, NULL, 
+			"mkdir(\"%s\", 0%o)", path, (int)mode);
+	
+	porg_leave();
+	return ret;
+}
+
+
+int remove(const char* path)
+{
+	int ret;
+	
+	porg_enter(PORG_HOOK_REMOVE);
+	porg_forget_paths();
+	
+	if ((ret = libc_remove(path)) != -1)
+		porg_log(PORG_OP_UNLINK, 0, path, NULL, "remove(\"%s\")", path);
+	
+	porg_leave();
 	return ret;
 }
 
@@ -363,11 +1494,14 @@ FILE* fopen(const char* path, const char* mode)
 {
 	FILE* ret;
 	
-	porg_init();
+	porg_enter(PORG_HOOK_FOPEN);
 	
-	if ((ret = libc_fopen(path, mode)) && strpbrk(mode, "wa+"))
-		porg_log(path, "fopen(\"%s\", \"%s\")", path, mode);
+	if ((ret = libc_fopen(path, mode)) && strpbrk(mode, "wa+")
+	&& porg_log(PORG_OP_OPEN, porg_fopen_flags(mode), path, NULL,
+			"fopen(\"%s\", \"%s\")", path, mode))
+		porg_watch_fd(fileno(ret));
 	
+	porg_leave();
 	return ret;
 }
 
@@ -376,11 +1510,14 @@ FILE* freopen(const char* path, const char* mode, FILE* stream)
 {
 	FILE* ret;
 	
-	porg_init();
+	porg_enter(PORG_HOOK_FREOPEN);
 	
-	if ((ret = libc_freopen(path, mode, stream)) && strpbrk(mode, "wa+"))
-		porg_log(path, "freopen(\"%s\", \"%s\")", path, mode);
+	if ((ret = libc_freopen(path, mode, stream)) && strpbrk(mode, "wa+")
+	&& porg_log(PORG_OP_OPEN, porg_fopen_flags(mode), path, NULL,
+			"freopen(\"%s\", \"%s\")", path, mode))
+		porg_watch_fd(fileno(ret));
 	
+	porg_leave();
 	return ret;
 }
 
@@ -392,10 +1529,10 @@ int open64(const char* path, int flags, ...)
 	va_list a;
 	int mode, accmode, ret;
 	
-	if (!porg_tmpfile && path && !strncmp(path, "/proc/", 6))
+	if (!porg_initialized && path && !strncmp(path, "/proc/", 6))
 		return __open64(path, flags);
 
-	porg_init();
+	porg_enter(PORG_HOOK_OPEN64);
 	
 	va_start(a, flags);
 	mode = va_arg(a, int);
@@ -403,10 +1540,15 @@ int open64(const char* path, int flags, ...)
 	
 	if ((ret = libc_open64(path, flags, mode)) != -1) {
 		accmode = flags & O_ACCMODE;
-		if (accmode == O_WRONLY || accmode == O_RDWR)
-			porg_log(path, "open64(\"%s\")", path);
+		if (accmode == O_WRONLY || accmode == O_RDWR) {
+			if (porg_log(PORG_OP_OPEN, flags, path, NULL, "open64(\"%s\")", path))
+				porg_watch_fd(ret);
+		}
+		else if (flags & O_DIRECTORY)
+			porg_add_dirfd(ret, -1, path);
 	}
 
+	porg_leave();
 	return ret;
 }
 
@@ -415,11 +1557,14 @@ int creat64(const char* path, mode_t mode)
 {
 	int ret;
 	
-	porg_init();
+	porg_enter(PORG_HOOK_CREAT64);
 	
-	if ((ret = libc_creat64(path, mode)) != -1)
-		porg_log(path, "creat64(\"%s\", 0%o)", path, mode);
+	if ((ret = libc_creat64(path, mode)) != -1
+	&& porg_log(PORG_OP_CREAT, O_CREAT | O_WRONLY | O_TRUNC, path, NULL,
+			"creat64(\"%s\", 0%o)", path, mode))
+		porg_watch_fd(ret);
 	
+	porg_leave();
 	return ret;
 }
 
@@ -428,12 +1573,15 @@ FILE* fopen64(const char* path, const char* mode)
 {
 	FILE* ret;
 	
-	porg_init();
+	porg_enter(PORG_HOOK_FOPEN64);
 	
 	ret = libc_fopen64(path, mode);
-	if (ret && strpbrk(mode, "wa+"))
-		porg_log(path, "fopen64(\"%s\", \"%s\")", path, mode);
+	if (ret && strpbrk(mode, "wa+")
+	&& porg_log(PORG_OP_OPEN, porg_fopen_flags(mode), path, NULL,
+			"fopen64(\"%s\", \"%s\")", path, mode))
+		porg_watch_fd(fileno(ret));
 	
+	porg_leave();
 	return ret;
 }
 
@@ -442,12 +1590,15 @@ FILE* freopen64(const char* path, const char* mode, FILE* stream)
 {
 	FILE* ret;
 	
-	porg_init();
+	porg_enter(PORG_HOOK_FREOPEN64);
 	
 	ret = libc_freopen64(path, mode, stream);
-	if (ret && strpbrk(mode, "wa+"))
-		porg_log(path, "freopen64(\"%s\", \"%s\")", path, mode);
+	if (ret && strpbrk(mode, "wa+")
+	&& porg_log(PORG_OP_OPEN, porg_fopen_flags(mode), path, NULL,
+			"freopen64(\"%s\", \"%s\")", path, mode))
+		porg_watch_fd(fileno(ret));
 	
+	porg_leave();
 	return ret;
 }
 
@@ -460,9 +1611,9 @@ int openat(int fd, const char* path, int flags, ...)
 {
 	va_list a;
 	int mode, accmode, ret;
-	static char abs_path[PORG_BUFSIZE];
+	char* abs_path;
 
-	porg_init();
+	porg_enter(PORG_HOOK_OPENAT);
 	
 	va_start(a, flags);
 	mode = va_arg(a, int);
@@ -471,11 +1622,17 @@ int openat(int fd, const char* path, int flags, ...)
 	if ((ret = libc_openat(fd, path, flags, mode)) != -1) {
 		accmode = flags & O_ACCMODE;
 		if (accmode == O_WRONLY || accmode == O_RDWR) {
+			abs_path = porg_thread()->at_path[0];
 			porg_get_absolute_path(fd, path, abs_path);
-			porg_log(abs_path, "openat(%d, \"%s\")", fd, path);
+			if (porg_log(PORG_OP_OPEN, flags, abs_path, NULL,
+				"openat(%d, \"%s\")", fd, path))
+				porg_watch_fd(ret);
 		}
+		else if (flags & O_DIRECTORY)
+			porg_add_dirfd(ret, fd, path);
 	}
 
+	porg_leave();
 	return ret;
 }
 
@@ -483,17 +1640,20 @@ int openat(int fd, const char* path, int flags, ...)
 int renameat(int oldfd, const char* oldpath, int newfd, const char* newpath)
 {
 	int ret;
-	static char old_abs_path[PORG_BUFSIZE];
-	static char new_abs_path[PORG_BUFSIZE];
+	char *old_abs_path, *new_abs_path;
 	
-	porg_init();
+	porg_enter(PORG_HOOK_RENAMEAT);
+	porg_forget_paths();
 
 	if ((ret = libc_renameat(oldfd, oldpath, newfd, newpath)) != -1) {
+		old_abs_path = porg_thread()->at_path[0];
+		new_abs_path = porg_thread()->at_path[1];
 		porg_get_absolute_path(oldfd, oldpath, old_abs_path);
 		porg_get_absolute_path(newfd, newpath, new_abs_path);
 		porg_log_rename(old_abs_path, new_abs_path);
 	}
 
+	porg_leave();
 	return ret;
 }
 
@@ -502,16 +1662,20 @@ int linkat(int oldfd, const char* oldpath,
            int newfd, const char* newpath, int flags)
 {
 	int ret;
-	static char new_abs_path[PORG_BUFSIZE];
+	char *old_abs_path, *new_abs_path;
 	
-	porg_init();
+	porg_enter(PORG_HOOK_LINKAT);
 
 	if ((ret = libc_linkat(oldfd, oldpath, newfd, newpath, flags)) != -1) {
+		old_abs_path = porg_thread()->at_path[0];
+		new_abs_path = porg_thread()->at_path[1];
+		porg_get_absolute_path(oldfd, oldpath, old_abs_path);
 		porg_get_absolute_path(newfd, newpath, new_abs_path);
-		porg_log(new_abs_path, "linkat(%d, \"%s\", %d, \"%s\")",
-			oldfd, oldpath, newfd, newpath);
+		porg_log(PORG_OP_LINK, 0, new_abs_path, old_abs_path,
+			"linkat(%d, \"%s\", %d, \"%s\")", oldfd, oldpath, newfd, newpath);
 	}
 
+	porg_leave();
 	return ret;
 }
 
@@ -519,16 +1683,58 @@ int linkat(int oldfd, const char* oldpath,
 int symlinkat(const char* oldpath, int newfd, const char* newpath)
 {
 	int ret;
-	static char new_abs_path[PORG_BUFSIZE];
+	char* new_abs_path;
 	
-	porg_init();
+	porg_enter(PORG_HOOK_SYMLINKAT);
 	
 	if ((ret = libc_symlinkat(oldpath, newfd, newpath)) != -1) {
+		new_abs_path = porg_thread()->at_path[0];
 		porg_get_absolute_path(newfd, newpath, new_abs_path);
-		porg_log(new_abs_path, "symlinkat(\"%s\", %d, \"%s\")", 
-			oldpath, newfd, newpath);
+		porg_log(PORG_OP_SYMLINK, 0, new_abs_path, oldpath,
+			"symlinkat(\"%s\", %d, \"%s\")", oldpath, newfd, newpath);
+	}
+
+	porg_leave();
+	return ret;
+}
+
+
+
+int unlinkat(int fd, const char* path, int flags)
+{
+	int ret;
+	char* abs_path;
+	
+	porg_enter(PORG_HOOK_UNLINKAT);
+	porg_forget_paths();
+	
+	if ((ret = libc_unlinkat(fd, path, flags)) != -1) {
+		abs_path = porg_thread()->at_path[0];
+		porg_get_absolute_path(fd, path, abs_path);
+		porg_log(flags & AT_REMOVEDIR ? PORG_OP_RMDIR : PORG_OP_UNLINK, 0, 
+			abs_path, NULL, "unlinkat(%d, \"%s\", %d)", fd, path, flags);
+	}
+
+	porg_leave();
+	return ret;
+}
+
+
+int mkdirat(int fd, const char* path, mode_t mode)
+{
+	int ret;
+	char* abs_path;
+	
+	porg_enter(PORG_HOOK_MKDIRAT);
+	
+	if ((ret = libc_mkdirat(fd, path, mode)) != -1) {
+		abs_path = porg_thread()->at_path[0];
+		porg_get_absolute_path(fd, path, abs_path);
+		porg_log(PORG_OP_MKDIR, 0, abs_path, NULL, 
+			"mkdirat(%d, \"%s\", 0%o)", fd, path, (int)mode);
 	}
 
+	porg_leave();
 	return ret;
 }
 
@@ -541,9 +1747,9 @@ int openat64(int fd, const char* path, int flags, ...)
 {
 	va_list a;
 	int mode, accmode, ret;
-	static char abs_path[PORG_BUFSIZE];
+	char* abs_path;
 
-	porg_init();
+	porg_enter(PORG_HOOK_OPENAT64);
 	
 	va_start(a, flags);
 	mode = va_arg(a, int);
@@ -552,11 +1758,17 @@ int openat64(int fd, const char* path, int flags, ...)
 	if ((ret = libc_openat64(fd, path, flags, mode)) != -1) {
 		accmode = flags & O_ACCMODE;
 		if (accmode == O_WRONLY || accmode == O_RDWR) {
+			abs_path = porg_thread()->at_path[0];
 			porg_get_absolute_path(fd, path, abs_path);
-			porg_log(abs_path, "openat64(%d, \"%s\")", fd, path);
+			if (porg_log(PORG_OP_OPEN, flags, abs_path, NULL,
+				"openat64(%d, \"%s\")", fd, path))
+				porg_watch_fd(ret);
 		}
+		else if (flags & O_DIRECTORY)
+			porg_add_dirfd(ret, fd, path);
 	}
 
+	porg_leave();
 	return ret;
 }
 
@@ -569,18 +1781,312 @@ int renameat2(int oldfd, const char* oldpath,
               unsigned int flags)
 {
 	int ret;
-	static char old_abs_path[PORG_BUFSIZE];
-	static char new_abs_path[PORG_BUFSIZE];
+	char *old_abs_path, *new_abs_path;
 	
-	porg_init();
+	porg_enter(PORG_HOOK_RENAMEAT2);
+	porg_forget_paths();
 
 	if ((ret = libc_renameat2(oldfd, oldpath, newfd, newpath, flags)) != -1) {
+		old_abs_path = porg_thread()->at_path[0];
+		new_abs_path = porg_thread()->at_path[1];
 		porg_get_absolute_path(oldfd, oldpath, old_abs_path);
 		porg_get_absolute_path(newfd, newpath, new_abs_path);
 		porg_log_rename(old_abs_path, new_abs_path);
 	}
 
+	porg_leave();
 	return ret;
 }
 
 #endif /* Have_RENAMEAT2 */
+
+
+/******************************************/
+/* Working directory and open directories */
+/******************************************/
+
+
+int chdir(const char* path)
+{
+	int ret;
+
+	porg_hook(PORG_HOOK_CHDIR);
+
+	if ((ret = libc_chdir(path)) != -1) {
+		porg_lock(&porg_paths_lock);
+		porg_set_path(&porg_cwd, NULL);
+		porg_unlock(&porg_paths_lock);
+	}
+
+	return ret;
+}
+
+
+int fchdir(int fd)
+{
+	int ret;
+
+	porg_hook(PORG_HOOK_FCHDIR);
+
+	if ((ret = libc_fchdir(fd)) != -1) {
+		porg_lock(&porg_paths_lock);
+		porg_set_path(&porg_cwd, fd < PORG_MAX_DIRFD ? porg_dirfd[fd] : NULL);
+		porg_unlock(&porg_paths_lock);
+	}
+
+	return ret;
+}
+
+
+int close(int fd)
+{
+	char* path;
+	int ret;
+
+	porg_hook(PORG_HOOK_CLOSE);
+	porg_set_dirfd(fd, NULL);
+
+	path = porg_unwatch_fd(fd);
+	
+	if ((ret = libc_close(fd)) != -1 && path)
+		porg_log_close(path);
+	
+	free(path);
+	return ret;
+}
+
+
+int fclose(FILE* stream)
+{
+	char* path;
+	int ret;
+
+	porg_hook(PORG_HOOK_FCLOSE);
+
+	path = porg_unwatch_fd(fileno(stream));
+	
+	if ((ret = libc_fclose(stream)) != EOF && path)
+		porg_log_close(path);
+	
+	free(path);
+	return ret;
+}
+
+
+int dup(int oldfd)
+{
+	int ret;
+
+	porg_hook(PORG_HOOK_DUP);
+
+	if ((ret = libc_dup(oldfd)) != -1)
+		porg_dup_dirfd(oldfd, ret);
+
+	return ret;
+}
+
+
+int dup2(int oldfd, int newfd)
+{
+	int ret;
+
+	porg_hook(PORG_HOOK_DUP2);
+
+	if ((ret = libc_dup2(oldfd, newfd)) != -1) {
+		porg_dup_dirfd(oldfd, newfd);
+		if (newfd != oldfd)
+			free(porg_unwatch_fd(newfd));
+	}
+
+	return ret;
+}
+
+
+#if HAVE_DUP3
+
+int dup3(int oldfd, int newfd, int flags)
+{
+	int ret;
+
+	porg_hook(PORG_HOOK_DUP3);
+
+	if ((ret = libc_dup3(oldfd, newfd, flags)) != -1) {
+		porg_dup_dirfd(oldfd, newfd);
+		free(porg_unwatch_fd(newfd));
+	}
+
+	return ret;
+}
+
+#endif	/* HAVE_DUP3 */
+
+
+int closedir(DIR* dir)
+{
+	porg_hook(PORG_HOOK_CLOSEDIR);
+	porg_set_dirfd(dirfd(dir), NULL);
+
+	return libc_closedir(dir);
+}
+
+
+
+/***************************/
+/* Process exit and exec() */
+/***************************/
+
+
+/*
+ * Collect the arguments of execl*() into a NULL terminated array.
+ */
+static char** porg_execl_argv(const char* arg, va_list* ap)
+{
+	char** argv = NULL;
+	size_t cnt = 0, max = 0;
+
+	for (;; arg = va_arg(*ap, const char*)) {
+		if (cnt == max) {
+			max = max ? max * 2 : 16;
+			if (!(argv = realloc(argv, max * sizeof(char*))))
+				porg_die("realloc(): %s", strerror(errno));
+		}
+		if (!(argv[cnt++] = (char*)arg))
+			return argv;
+	}
+}
+
+
+int execve(const char* path, char* const argv[], char* const envp[])
+{
+	porg_init();
+	porg_send_stats();
+	porg_flush();
+
+	return libc_execve(path, argv, envp);
+}
+
+
+int execv(const char* path, char* const argv[])
+{
+	porg_init();
+	porg_send_stats();
+	porg_flush();
+
+	return libc_execv(path, argv);
+}
+
+
+int execvp(const char* file, char* const argv[])
+{
+	porg_init();
+	porg_send_stats();
+	porg_flush();
+
+	return libc_execvp(file, argv);
+}
+
+
+int execl(const char* path, const char* arg, ...)
+{
+	va_list a;
+	char** argv;
+	int ret;
+
+	porg_init();
+	porg_send_stats();
+	porg_flush();
+
+	va_start(a, arg);
+	argv = porg_execl_argv(arg, &a);
+	va_end(a);
+
+	ret = libc_execv(path, argv);
+	free(argv);
+
+	return ret;
+}
+
+
+int execlp(const char* file, const char* arg, ...)
+{
+	va_list a;
+	char** argv;
+	int ret;
+
+	porg_init();
+	porg_send_stats();
+	porg_flush();
+
+	va_start(a, arg);
+	argv = porg_execl_argv(arg, &a);
+	va_end(a);
+
+	ret = libc_execvp(file, argv);
+	free(argv);
+
+	return ret;
+}
+
+
+int execle(const char* path, const char* arg, ...)
+{
+	va_list a;
+	char** argv;
+	char* const* envp;
+	int ret;
+
+	porg_init();
+	porg_send_stats();
+	porg_flush();
+
+	va_start(a, arg);
+	argv = porg_execl_argv(arg, &a);
+	envp = va_arg(a, char* const*);
+	va_end(a);
+
+	ret = libc_execve(path, argv, envp);
+	free(argv);
+
+	return ret;
+}
+
+
+#if HAVE_EXECVPE
+
+int execvpe(const char* file, char* const argv[], char* const envp[])
+{
+	porg_init();
+	porg_send_stats();
+	porg_flush();
+
+	return libc_execvpe(file, argv, envp);
+}
+
+#endif	/* HAVE_EXECVPE */
+
+
+#if HAVE_FEXECVE
+
+int fexecve(int fd, char* const argv[], char* const envp[])
+{
+	porg_init();
+	porg_send_stats();
+	porg_flush();
+
+	return libc_fexecve(fd, argv, envp);
+}
+
+#endif	/* HAVE_FEXECVE */
+
+
+/* 
+ * _exit() skips the destructors, so flush the pending paths here
+ */
+void _exit(int status)
+{
+	porg_init();
+	porg_send_stats();
+	porg_flush();
+
+	libc__exit(status);
+}
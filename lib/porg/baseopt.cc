@@ -17,6 +17,7 @@ using std::string;
 using namespace Porg;
 
 static string sh_expand(string const&);
+static PathList const& compiled(PathList&, string const&);
 
 string BaseOpt::s_logdir		= LOGDIR;
 string BaseOpt::s_include		= "/";
@@ -53,6 +54,27 @@ BaseOpt::BaseOpt()
 }
 
 
+PathList const& BaseOpt::include_paths()
+{
+	static PathList paths;
+	return compiled(paths, s_include);
+}
+
+
+PathList const& BaseOpt::exclude_paths()
+{
+	static PathList paths;
+	return compiled(paths, s_exclude);
+}
+
+
+PathList const& BaseOpt::remove_skip_paths()
+{
+	static PathList paths;
+	return compiled(paths, s_remove_skip);
+}
+
+
 bool BaseOpt::logdir_writable()
 {
 	return !access(s_logdir.c_str(), W_OK);
@@ -74,3 +96,16 @@ static string sh_expand(string const& str)
   	return ret;
 }
 
+
+//
+// Recompile @paths if @list has changed since the last call. The first call
+// must not be concurrent with other ones.
+//
+static PathList const& compiled(PathList& paths, string const& list)
+{
+	if (paths.list() != list)
+		paths = PathList(list);
+
+	return paths;
+}
+
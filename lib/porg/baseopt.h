@@ -10,6 +10,7 @@
 #define LIBPORG_BASEOPT_H
 
 #include "config.h"
+#include "pathlist.h"
 #include <string>
 
 namespace Porg {
@@ -25,6 +26,11 @@ class BaseOpt
 	static std::string const& include()		{ return s_include; }
 	static std::string const& exclude()		{ return s_exclude; }
 	static std::string const& remove_skip()	{ return s_remove_skip; }
+
+	// the lists above, compiled on first use (and again if changed)
+	static PathList const& include_paths();
+	static PathList const& exclude_paths();
+	static PathList const& remove_skip_paths();
 	
 	static bool logdir_writable();
 
@@ -9,11 +9,13 @@
 #include "config.h"
 #include "basepkg.h"
 #include "baseopt.h"
-#include "file.h"
 #include <fstream>
 #include <algorithm>
+#include <iterator>
 #include <sstream>
 #include <iomanip>
+#include <fcntl.h>
+#include <sys/mman.h>
 
 using std::string;
 using namespace Porg;
@@ -22,6 +24,8 @@ using namespace Porg;
 BasePkg::BasePkg(string const& name_)
 :
 	m_files(),
+	m_dirs(),
+	m_dirs_logged(false),
 	m_inodes(),
 	m_name(name_),
 	m_log(BaseOpt::logdir() + "/" + name_),
@@ -37,7 +41,9 @@ BasePkg::BasePkg(string const& name_)
 	m_description(),
 	m_conf_opts(),
 	m_author(),
-	m_sorted_by_name(false)
+	m_files_pending(false),
+	m_files_offset(0),
+	m_log_format(LOG_FORMAT)
 { }
 
 
@@ -55,9 +61,9 @@ void BasePkg::read_info_line(string const& buf)
 
 	switch (buf[1]) {
 
-		case CODE_DATE: 		m_date = str2num<int>(val);		break;
-		case CODE_SIZE: 		m_size = str2num<float>(val);	break;
-		case CODE_NFILES: 		m_nfiles = str2num<ulong>(val);	break;
+		case CODE_DATE: 		m_date = strtol(val.c_str(), 0, 10);	break;
+		case CODE_SIZE: 		m_size = strtod(val.c_str(), 0);		break;
+		case CODE_NFILES: 		m_nfiles = strtoul(val.c_str(), 0, 10);	break;
 		case CODE_CONF_OPTS:	m_conf_opts = val; 				break;
 		case CODE_ICON_PATH:	m_icon_path = val;				break;
 		case CODE_SUMMARY: 		m_summary = val; 				break;
@@ -69,55 +75,175 @@ void BasePkg::read_info_line(string const& buf)
 				m_description += "\n";
 			m_description += val;
 			break;
+		case CODE_DIR:
+			m_dirs_logged = true;
+			if (!val.empty())
+				m_dirs.push_back(val);
+			break;
 		
 		default: assert(false); break;
 	}
 }
 	
 
+//
+// A log file mapped in memory, read-only.
+//
+class LogMap
+{
+	public:
+
+	LogMap(string const& path)
+	:
+		m_data(0),
+		m_size(0)
+	{
+		int fd = open(path.c_str(), O_RDONLY);
+		struct stat s;
+
+		if (fd < 0 || fstat(fd, &s) < 0) {
+			int errno_ = errno;
+			if (fd >= 0)
+				close(fd);
+			throw Error(path, errno_);
+		}
+
+		if ((m_size = s.st_size) > 0) {
+			void* p = mmap(0, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (p == MAP_FAILED) {
+				int errno_ = errno;
+				close(fd);
+				throw Error("mmap(" + path + ")", errno_);
+			}
+			m_data = static_cast<char const*>(p);
+			madvise(p, m_size, MADV_SEQUENTIAL);
+		}
+
+		close(fd);
+	}
+
+	~LogMap()
+	{
+		if (m_data)
+			munmap(const_cast<char*>(m_data), m_size);
+	}
+
+	char const* begin() const	{ return m_data; }
+	char const* end() const		{ return m_data + m_size; }
+
+	private:
+
+	char const*	m_data;
+	size_t		m_size;
+
+	LogMap(LogMap const&);
+	LogMap& operator=(LogMap const&);
+
+};	// class LogMap
+
+
+//
+// Read the log: The header, and the list of files.
+//
 void BasePkg::read_log()
 {
-	FileStream<std::ifstream> f(m_log);
-	string buf;
-	
-	if (!(getline(f, buf) && buf.find("#!porg") == 0))
+	read_log_header();
+	load_files();
+}
+
+
+//
+// Read the header of the log only, up to the first file. The files are
+// read on first use (see load_files()), so that the modes that need just
+// the package information don't parse them.
+//
+void BasePkg::read_log_header()
+{
+	LogMap log(m_log);
+	char const* p = log.begin();
+	char const* const end = log.end();
+
+	if (end - p >= 6 && !memcmp(p, "#!porg", 6))
+		m_log_format = 1;
+	else if (end - p >= 7 && !memcmp(p, "#%porg-", 7))
+		m_log_format = strtol(p + 7, 0, 10);
+	else
 		throw Error(m_log + ": '#!porg' header missing");
 
-	char path[4096], link_path[4096];
-	ulong size;
-
-	while (getline(f, buf)) {
-
-		switch (sscanf(buf.c_str(), "%[^|]|%lu|%s", path, &size, link_path)) {
-
-			case 1:	// info header
-				read_info_line(buf);
-				break;
-			
-			case 2: // regular file
-				m_files.push_back(new File(path, size)); 
-				break;
-			
-			case 3: // symlink
-				m_files.push_back(new File(path, size, link_path)); 
-				break;
-			
-			default: // parse error
-				assert(false);
-				break;
-		}
+	if (m_log_format < 1 || m_log_format > LOG_FORMAT)
+		throw Error(m_log + ": Unknown log format (written by a newer porg?)");
+
+	for (char const* eol; p < end && *p == '#'; p = eol + 1) {
+
+		if (!(eol = static_cast<char const*>(memchr(p, '\n', end - p))))
+			eol = end;
+
+		// info header, as '#<char>:<value>'
+		if (eol - p > 2 && p[2] == ':')
+			read_info_line(string(p, eol));
 	}
 
-	sort_files();
+	m_files_offset = p - log.begin();
+	m_files_pending = true;
 }
 
 
-BasePkg::~BasePkg()
+//
+// Read the files from the log, if not done yet, mapping it in memory. Lines
+// are split with memchr(), and the entries of the table are built straight
+// from the mapped bytes.
+//
+void BasePkg::load_files() const
 {
-	for (iter f(m_files.begin()); f != m_files.end(); delete *f++) ;
+	if (!m_files_pending)
+		return;
+
+	m_files_pending = false;
+
+	LogMap log(m_log);
+	char const* const end = log.end();
+	char const* p = log.begin() + std::min<size_t>(m_files_offset, end - log.begin());
+
+	// the number of files is in the header, and their names, symlinks
+	// and checksums take less than the rest of the log
+	m_files.reserve(m_nfiles, end - p);
+
+	for (char const* eol; p < end; p = eol + 1) {
+
+		if (!(eol = static_cast<char const*>(memchr(p, '\n', end - p))))
+			eol = end;
+
+		// installed file, as 'path|size|symlink' or 'path|size||checksum'
+		// (in format 1, anything after the second '|' is the symlink)
+
+		char const* bar = static_cast<char const*>(memchr(p, '|', eol - p));
+		if (*p == '#' || !bar)
+			continue;
+
+		ulong size = 0;
+		char const* q = bar + 1;
+
+		for ( ; q < eol && *q >= '0' && *q <= '9'; ++q)
+			size = size * 10 + (*q - '0');
+
+		if (q >= eol || *q != '|' || ++q >= eol)
+			m_files.add(p, bar - p, size);
+		else if (*q == '|' && m_log_format > 1)
+			m_files.add(p, bar - p, size, 0, 0, q + 1, eol - q - 1);
+		else if (*q == '\\' && m_log_format > 1 && q + 1 < eol)
+			m_files.add(p, bar - p, size, q + 1, eol - q - 1);
+		else
+			m_files.add(p, bar - p, size, q, eol - q);
+	}
+
+	m_files.sort();
 }
 
 
+BasePkg::~BasePkg()
+{ }
+
+
 void BasePkg::unlog() const
 {
 	if (unlink(m_log.c_str()) != 0 && errno != ENOENT)
@@ -161,13 +287,18 @@ string BasePkg::format_description() const
 
 void BasePkg::write_log() const
 {
+	// the files must be read before the log is overwritten, and they are
+	// written sorted by name so that they need no sorting when read back
+	load_files();
+	m_files.sort();
+
 	// Create log file
 
 	FileStream<std::ofstream> of(m_log);
 
 	// write info header
 
-	of	<< "#!porg-" PACKAGE_VERSION "\n"
+	of	<< "#%porg-" << LOG_FORMAT << " porg-" PACKAGE_VERSION "\n"
 		<< '#' << CODE_DATE 		<< ':' << m_date << '\n'
 		<< '#' << CODE_SIZE 		<< ':' << std::setprecision(0) << std::fixed << m_size << '\n'
 		<< '#' << CODE_NFILES       << ':' << m_nfiles << '\n'
@@ -179,58 +310,85 @@ void BasePkg::write_log() const
 		<< '#' << CODE_ICON_PATH	<< ':' << m_icon_path << '\n'
 		<< format_description();
 
-	// write installed files
+	// write created directories (an empty line if none)
+
+	if (m_dirs_logged && m_dirs.empty())
+		of << '#' << CODE_DIR << ":\n";
 	
-	for (const_iter f(m_files.begin()); f != m_files.end(); ++f)
-		of << (*f)->name() << '|' << (*f)->size() << '|' << (*f)->ln_name() << '\n';
+	for (uint i(0); i < m_dirs.size(); ++i)
+		of << '#' << CODE_DIR << ':' << m_dirs[i] << '\n';
+
+	// write installed files, as 'path|size|symlink' or 'path|size||checksum'.
+	// A symlink beginning with '|' or '\' is escaped with a '\', not to be
+	// taken for a checksum.
+	
+	for (const_iter f(m_files.begin()); f != m_files.end(); ++f) {
+		char const* ln = f->c_ln_name();
+		char const* digest = f->c_digest();
+		of << f->c_name() << '|' << f->size() << '|';
+		if (*ln == '|' || *ln == '\\')
+			of << '\\';
+		of << ln;
+		if (*digest)
+			of << '|' << digest;
+		of << '\n';
+	}
 }
 
 
-void BasePkg::log_file(string const& path)
+//
+// Log a newly installed file.
+//
+void BasePkg::log_file(string const& path, struct stat const& st,
+                       string const& ln_name, string const& digest)
 {
-	File* file = new File(path);
-	m_files.push_back(file);
+	m_files.add(path.data(), path.size(), st.st_size, ln_name.data(), ln_name.size(),
+		digest.data(), digest.size());
 
 	m_nfiles++;
 
 	// detect hardlinks to installed files, to count their size only once
+	// (missing files, logged with -j, have no inode)
 	
-	assert(file->inode() > 0);
-	
-	if (m_inodes.find(file->inode()) == m_inodes.end()) {
-		m_inodes.insert(file->inode());
-		m_size += file->size();
-	}
+	if (st.st_ino && m_inodes.insert(std::make_pair(st.st_dev, st.st_ino)).second)
+		m_size += st.st_size;
 }
 
 
-bool BasePkg::find_file(File* file)
+//
+// Add the directories created by the package (sorted, without repeats).
+// Return whether any of them was not logged yet.
+//
+bool BasePkg::log_dirs(std::vector<string> const& dirs)
 {
-	assert(file != NULL);
+	std::vector<string> all;
+	all.reserve(m_dirs.size() + dirs.size());
 
-	if (!m_sorted_by_name)
-		sort_files();
+	std::set_union(m_dirs.begin(), m_dirs.end(), dirs.begin(), dirs.end(),
+		std::back_inserter(all));
+
+	bool added = all.size() > m_dirs.size();
 	
-	return std::binary_search(m_files.begin(), m_files.end(), file, Sorter());
+	m_dirs.swap(all);
+	m_dirs_logged = true;
+
+	return added;
 }
 
 
 bool BasePkg::find_file(string const& path)
 {
-	File file(path);
-	return find_file(&file);
+	load_files();
+	return m_files.find(path);
 }
 
 
 void BasePkg::sort_files(	sort_t type,	// = SORT_BY_NAME
 							bool reverse)	// = false
 {
-	std::sort(m_files.begin(), m_files.end(), Sorter(type));
-	
-	if (reverse)
-		std::reverse(m_files.begin(), m_files.end());
-	
-	m_sorted_by_name = (type == SORT_BY_NAME && !reverse);
+	load_files();
+
+	m_files.sort(type, reverse);
 }
 
 
@@ -253,32 +411,3 @@ string BasePkg::get_version(string const& name)
 	return "";
 }
 
-
-//-----------------//
-// BasePkg::Sorter //
-//-----------------//
-
-
-BasePkg::Sorter::Sorter(sort_t type /* = SORT_BY_NAME */)
-:
-	m_sort_func(type == SORT_BY_NAME ? &Sorter::sort_by_name : &Sorter::sort_by_size)
-{ }
-
-
-inline bool BasePkg::Sorter::operator()(File* left, File* right) const
-{
-	return (this->*m_sort_func)(left, right);
-}
-
-
-inline bool BasePkg::Sorter::sort_by_name(File* left, File* right) const
-{
-	return left->name() < right->name();
-}
-
-
-inline bool BasePkg::Sorter::sort_by_size(File* left, File* right) const
-{
-	return left->size() > right->size();
-}
-
@@ -11,6 +11,7 @@
 
 #include "config.h"
 #include "common.h"
+#include "filetable.h"
 #include <iosfwd>
 #include <vector>
 #include <set>
@@ -18,14 +19,11 @@
 
 namespace Porg {
 
-class File;
-
 class BasePkg
 {
 	public:
 
-	typedef std::vector<File*>::iterator 		iter;
-	typedef std::vector<File*>::const_iterator 	const_iter;
+	typedef FileTable::const_iterator 	const_iter;
 
 	// codes used to identify fields in the header of log files
 	static char const CODE_DATE			= 't';
@@ -38,11 +36,19 @@ class BasePkg
 	static char const CODE_LICENSE		= 'l';
 	static char const CODE_AUTHOR		= 'a';
 	static char const CODE_DESCRIPTION	= 'd';
+	static char const CODE_DIR			= 'D';
+
+	// format of the logs written (the highest one read). Format 2 logs begin
+	// with '#%porg-2', not to be taken by older porg versions, that expect
+	// '#!porg' and don't know the checksums and directories.
+	static int const LOG_FORMAT			= 2;
 
 	BasePkg(std::string const& name_);
 	virtual ~BasePkg();
 
-	std::vector<File*> const& files() const	{ return m_files; }
+	FileTable const& files() const			{ load_files(); return m_files; }
+	std::vector<std::string> const& dirs() const { return m_dirs; }
+	bool dirs_logged() const				{ return m_dirs_logged; }
 	int date() const						{ return m_date; }
 	float size() const						{ return m_size; }
 	ulong nfiles() const					{ return m_nfiles; }
@@ -58,20 +64,20 @@ class BasePkg
 	std::string const& conf_opts() const	{ return m_conf_opts; }
 	std::string const& author() const		{ return m_author; }
 
-	bool find_file(File*);
 	bool find_file(std::string const& path);
 	virtual void unlog() const;
 	void write_log() const;
 	void read_log();
+	void read_log_header();
 	
 	static std::string get_base(std::string const& name);
 	static std::string get_version(std::string const& name);
 
 	template <typename T>	// T = {Pkg,BasePkg}
-	bool is_shared(File* file, std::vector<T*> const& pkgs) const
+	bool is_shared(std::string const& path, std::vector<T*> const& pkgs) const
 	{
 		for (typename std::vector<T*>::const_iterator p(pkgs.begin()); p != pkgs.end(); ++p) {
-			if ((*p)->name() != m_name && (*p)->find_file(file))
+			if ((*p)->name() != m_name && (*p)->find_file(path))
 				return true;
 		}
 		return false;
@@ -80,13 +86,18 @@ class BasePkg
 	protected:
 
 	void read_info_line(std::string const&);
+	void load_files() const;
 	void sort_files(sort_t type = SORT_BY_NAME, bool reverse = false);
 	std::string format_description() const;
-	void log_file(std::string const& path);
+	void log_file(std::string const& path, struct stat const& st,
+	              std::string const& ln_name, std::string const& digest);
+	bool log_dirs(std::vector<std::string> const& dirs);
 	std::string description_str(bool debug = false) const;
 
-	std::vector<File*> m_files;
-	std::set<ino_t> m_inodes;
+	mutable FileTable m_files;
+	std::vector<std::string> m_dirs;	// created directories, sorted
+	bool m_dirs_logged;					// whether m_dirs is known
+	std::set<std::pair<dev_t, ino_t> > m_inodes;
 	std::string const m_name;
 	std::string const m_log;
 	std::string const m_base_name;
@@ -101,22 +112,9 @@ class BasePkg
 	std::string m_description;
 	std::string m_conf_opts;
 	std::string m_author;
-	bool m_sorted_by_name;
-
-	class Sorter
-	{
-		public:
-
-		Sorter(sort_t type = SORT_BY_NAME);
-		bool operator()(File* left, File* right) const;
-
-		private:
-
-		bool (Sorter::*m_sort_func)(File* , File*) const;
-		bool sort_by_name(File* left, File* right) const;
-		bool sort_by_size(File* left, File* right) const;
-
-	};	// class BasePkg::Sorter
+	mutable bool m_files_pending;		// files not read from the log yet
+	size_t m_files_offset;				// where the files begin in the log
+	int m_log_format;					// of the log read
 
 };	// class BasePkg
 
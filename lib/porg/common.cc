@@ -8,14 +8,12 @@
 
 #include "config.h"
 #include "common.h"
+#include "pathlist.h"
 #include <sstream>
 #include <iomanip>
-#include <fnmatch.h>
 
 using std::string;
 
-static string strip_repeated(string const&, char);
-
 
 //
 // Create a human readable size
@@ -65,47 +63,11 @@ string Porg::fmt_date(time_t date, bool print_hour)
 // expansion, but with the following exception: If a path in the list does not
 // contain any wildcard, and it is a directory, it matches any file within that
 // directory.
+// To match many paths against the same list, use a PathList instead.
 //
 bool Porg::in_paths(string const& inpath, string const& list)
 {
-	std::istringstream s(list + ":");
-	string path = strip_trailing(inpath, '/');
-
-	for (string buf; getline(s, buf, ':'); ) {
-
-		if (buf.empty())
-			continue;
-
-		buf = strip_repeated(strip_trailing(buf, '/'), '/');
-		
-		if (buf == "/")
-			return true;
-
-		else if (buf.find_first_of("*?[") == string::npos) {
-			if (buf == path || !path.find(buf + "/"))
-				return true;
-		}
-		
-		else if (!fnmatch(buf.c_str(), path.c_str(), 0))
-			return true;
-	}
-
-	return false;
-}
-
-
-//
-// Strip consecutive repeated occurrences of character c in str.
-//
-string strip_repeated(string const& str, char c)
-{
-	string ret = str, cc(2, c);
-	string::size_type p;
-
-	while ((p = ret.find(cc)) != string::npos)
-		ret.erase(p, 1);
-	
-	return ret;
+	return PathList(list).match(inpath);
 }
 
 
@@ -0,0 +1,148 @@
+//=======================================================================
+// filetable.cc
+//-----------------------------------------------------------------------
+// This file is part of the package porg
+// Copyright (C) 2015 David Ricart
+// For more information visit http://porg.sourceforge.net
+//=======================================================================
+
+#include "config.h"
+#include "filetable.h"
+#include <algorithm>
+
+using std::string;
+using namespace Porg;
+
+
+FileTable::FileTable()
+:
+	m_arena(),
+	m_names(),
+	m_sizes(),
+	m_order(),
+	m_ln_names(),
+	m_digests(),
+	m_sorted_by_name(true)
+{ }
+
+
+void FileTable::reserve(size_t nfiles, size_t nbytes)
+{
+	m_names.reserve(m_names.size() + nfiles);
+	m_sizes.reserve(m_sizes.size() + nfiles);
+	m_order.reserve(m_order.size() + nfiles);
+	m_arena.reserve(m_arena.size() + nbytes);
+}
+
+
+//
+// Copy a string to the arena, and return its offset.
+//
+uint32_t FileTable::store(char const* s, size_t len)
+{
+	size_t off = m_arena.size();
+
+	if (off + len + 1 > UINT32_MAX)
+		throw Error("Too many files");
+
+	m_arena.insert(m_arena.end(), s, s + len);
+	m_arena.push_back(0);
+
+	return off;
+}
+
+
+void FileTable::add(char const* name, size_t name_len, ulong size,
+                    char const* ln_name, size_t ln_len,
+                    char const* digest, size_t digest_len)
+{
+	uint32_t id = m_names.size();
+
+	if (m_sorted_by_name && id && strncmp(str(m_names[m_order.back()]), name, name_len) >= 0)
+		m_sorted_by_name = false;
+
+	m_names.push_back(store(name, name_len));
+	m_sizes.push_back(size);
+	m_order.push_back(id);
+
+	if (ln_len)
+		m_ln_names.push_back(std::make_pair(id, store(ln_name, ln_len)));
+	if (digest_len)
+		m_digests.push_back(std::make_pair(id, store(digest, digest_len)));
+}
+
+
+void FileTable::clear()
+{
+	*this = FileTable();
+}
+
+
+//
+// Return the string of file 'id' in a side table, or NULL if not there.
+//
+char const* FileTable::lookup(SideTable const& table, uint32_t id) const
+{
+	SideTable::const_iterator i = std::lower_bound(table.begin(), table.end(),
+		std::make_pair(id, uint32_t(0)));
+
+	return (i != table.end() && i->first == id) ? str(i->second) : 0;
+}
+
+
+void FileTable::sort(	sort_t type,	// = SORT_BY_NAME
+						bool reverse)	// = false
+{
+	if (type == SORT_BY_NAME && !reverse && m_sorted_by_name)
+		return;
+	else if (type == SORT_BY_NAME)
+		std::sort(m_order.begin(), m_order.end(), [this](uint32_t l, uint32_t r)
+			{ return strcmp(str(m_names[l]), str(m_names[r])) < 0; });
+	else
+		std::sort(m_order.begin(), m_order.end(), [this](uint32_t l, uint32_t r)
+			{ return m_sizes[l] > m_sizes[r]; });
+
+	if (reverse)
+		std::reverse(m_order.begin(), m_order.end());
+
+	m_sorted_by_name = (type == SORT_BY_NAME && !reverse);
+}
+
+
+bool FileTable::find(string const& path)
+{
+	if (!m_sorted_by_name)
+		sort();
+
+	std::vector<uint32_t>::const_iterator i = std::lower_bound(m_order.begin(),
+		m_order.end(), path.c_str(), [this](uint32_t l, char const* r)
+			{ return strcmp(str(m_names[l]), r) < 0; });
+
+	return i != m_order.end() && path == str(m_names[*i]);
+}
+
+
+//------------------//
+// FileTable::Entry //
+//------------------//
+
+
+char const* FileTable::Entry::c_ln_name() const
+{
+	char const* ln = m_table->lookup(m_table->m_ln_names, m_id);
+	return ln ? ln : "";
+}
+
+
+char const* FileTable::Entry::c_digest() const
+{
+	char const* d = m_table->lookup(m_table->m_digests, m_id);
+	return d ? d : "";
+}
+
+
+bool FileTable::Entry::is_missing() const
+{
+	struct stat s;
+	return lstat(m_table->str(m_table->m_names[m_id]), &s);
+}
@@ -0,0 +1,155 @@
+//=======================================================================
+// filetable.h
+//-----------------------------------------------------------------------
+// This file is part of the package porg
+// Copyright (C) 2015 David Ricart
+// For more information visit http://porg.sourceforge.net
+//=======================================================================
+
+#ifndef LIBPORG_FILETABLE_H
+#define LIBPORG_FILETABLE_H
+
+#include "config.h"
+#include "common.h"
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+
+namespace Porg {
+
+//
+// The files of a package, stored column-wise: the names, symlinks and
+// checksums are kept one after the other, null-terminated, in a single
+// buffer (the arena), and the table only holds offsets into it.
+// Symlinks and checksums are rare, so they are kept in separate tables
+// of (file, offset) pairs instead of in a column of their own.
+// Files are sorted and searched through a permutation of their indexes,
+// without moving any data.
+//
+class FileTable
+{
+	public:
+
+	class Entry;
+	class const_iterator;
+
+	FileTable();
+
+	size_t size() const					{ return m_order.size(); }
+	bool empty() const					{ return m_order.empty(); }
+	Entry operator[](size_t i) const;
+	const_iterator begin() const;
+	const_iterator end() const;
+
+	void reserve(size_t nfiles, size_t nbytes);
+	void add(char const* name, size_t name_len, ulong size,
+	         char const* ln_name = 0, size_t ln_len = 0,
+	         char const* digest = 0, size_t digest_len = 0);
+	void clear();
+
+	void sort(sort_t type = SORT_BY_NAME, bool reverse = false);
+	bool find(std::string const& path);
+
+	private:
+
+	typedef std::vector<std::pair<uint32_t, uint32_t> > SideTable;
+
+	std::vector<char>		m_arena;
+	std::vector<uint32_t>	m_names;	// offsets of the names in the arena
+	std::vector<ulong>		m_sizes;
+	std::vector<uint32_t>	m_order;	// indexes of the files, as sorted
+	SideTable				m_ln_names;	// (index, offset), sorted by index
+	SideTable				m_digests;	// idem
+	bool					m_sorted_by_name;
+
+	char const* str(uint32_t off) const	{ return &m_arena[off]; }
+	char const* lookup(SideTable const&, uint32_t id) const;
+	uint32_t store(char const* s, size_t len);
+
+	public:
+
+	//
+	// A file of the table, as returned by operator[] and the iterators.
+	// It's only valid as long as the table is not modified.
+	//
+	class Entry
+	{
+		public:
+
+		Entry() : m_table(0), m_id(0) { }
+
+		// the c_*() strings point into the table ("" if none), and are
+		// only valid as long as it is not modified
+		char const* c_name() const		{ return m_table->str(m_table->m_names[m_id]); }
+		char const* c_ln_name() const;
+		char const* c_digest() const;
+
+		std::string name() const		{ return c_name(); }
+		ulong size() const				{ return m_table->m_sizes[m_id]; }
+		std::string ln_name() const		{ return c_ln_name(); }
+		std::string digest() const		{ return c_digest(); }
+		bool is_symlink() const			{ return m_table->lookup(m_table->m_ln_names, m_id); }
+		bool is_missing() const;
+
+		private:
+
+		friend class FileTable;
+
+		Entry(FileTable const* table, uint32_t id) : m_table(table), m_id(id) { }
+
+		FileTable const* m_table;
+		uint32_t m_id;
+
+	};	// class FileTable::Entry
+
+	class const_iterator
+	{
+		public:
+
+		const_iterator() : m_table(0), m_pos(0), m_entry() { }
+
+		Entry const& operator*() const			{ m_entry = (*m_table)[m_pos]; return m_entry; }
+		Entry const* operator->() const			{ return &**this; }
+		const_iterator& operator++()			{ ++m_pos; return *this; }
+		const_iterator operator++(int)			{ const_iterator i(*this); ++m_pos; return i; }
+		bool operator==(const_iterator const& i) const	{ return m_pos == i.m_pos; }
+		bool operator!=(const_iterator const& i) const	{ return m_pos != i.m_pos; }
+
+		private:
+
+		friend class FileTable;
+
+		const_iterator(FileTable const* table, size_t pos)
+		: m_table(table), m_pos(pos), m_entry() { }
+
+		FileTable const* m_table;
+		size_t m_pos;
+		mutable Entry m_entry;
+
+	};	// class FileTable::const_iterator
+
+};	// class FileTable
+
+
+inline FileTable::Entry FileTable::operator[](size_t i) const
+{
+	return Entry(this, m_order[i]);
+}
+
+
+inline FileTable::const_iterator FileTable::begin() const
+{
+	return const_iterator(this, 0);
+}
+
+
+inline FileTable::const_iterator FileTable::end() const
+{
+	return const_iterator(this, m_order.size());
+}
+
+}	// namespace Porg
+
+
+#endif  // LIBPORG_FILETABLE_H
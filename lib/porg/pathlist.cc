@@ -0,0 +1,103 @@
+//=======================================================================
+// pathlist.cc
+//-----------------------------------------------------------------------
+// This file is part of the package porg
+// Copyright (C) 2015 David Ricart
+// For more information visit http://porg.sourceforge.net
+//=======================================================================
+
+#include "config.h"
+#include "pathlist.h"
+#include "common.h"	// strip_trailing()
+#include <algorithm>
+#include <sstream>
+#include <fnmatch.h>
+
+using std::string;
+using namespace Porg;
+
+
+PathList::PathList(string const& list)
+:
+	m_list(list),
+	m_str(),
+	m_all(false),
+	m_literals(),
+	m_globs()
+{
+	std::istringstream is(list + ":");
+
+	for (string buf; getline(is, buf, ':'); ) {
+
+		if (buf.empty())
+			continue;
+
+		for (string::size_type p; (p = buf.find("//")) != string::npos; )
+			buf.erase(p, 1);
+
+		buf = strip_trailing(buf, '/');
+		m_str += (m_str.empty() ? "" : ":") + buf;
+
+		if (buf == "/")
+			m_all = true;
+		else if (buf.find_first_of("*?[") == string::npos)
+			m_literals.push_back(buf);
+		else
+			m_globs.push_back(buf);
+	}
+
+	std::sort(m_literals.begin(), m_literals.end());
+	m_literals.erase(std::unique(m_literals.begin(), m_literals.end()),
+		m_literals.end());
+}
+
+
+//
+// Whether the first len characters of path are an entry without wildcards.
+//
+bool PathList::is_literal(string const& path, string::size_type len) const
+{
+	std::vector<string>::const_iterator l = std::lower_bound(m_literals.begin(),
+		m_literals.end(), path, [len](string const& a, string const& b)
+		{ return a.compare(0, string::npos, b, 0, len) < 0; });
+
+	return l != m_literals.end() && !l->compare(0, string::npos, path, 0, len);
+}
+
+
+//
+// Same as in_paths(path, list()).
+//
+bool PathList::match(string const& inpath) const
+{
+	if (m_all)
+		return true;
+
+	string::size_type len = inpath.size();
+	while (len > 1 && inpath[len - 1] == '/')
+		len--;
+
+	if (!m_literals.empty()) {
+		// the path itself, and each of its parent directories
+		for (string::size_type p = 0; p < len; ) {
+			p = inpath.find('/', p + 1);
+			if (p == string::npos || p > len)
+				p = len;
+			if (is_literal(inpath, p))
+				return true;
+		}
+	}
+
+	if (m_globs.empty())
+		return false;
+
+	string path(inpath, 0, len);
+
+	for (std::vector<string>::const_iterator g(m_globs.begin());
+	g != m_globs.end(); ++g) {
+		if (!fnmatch(g->c_str(), path.c_str(), 0))
+			return true;
+	}
+
+	return false;
+}
@@ -0,0 +1,53 @@
+//=======================================================================
+// pathlist.h
+//-----------------------------------------------------------------------
+// This file is part of the package porg
+// Copyright (C) 2015 David Ricart
+// For more information visit http://porg.sourceforge.net
+//=======================================================================
+
+#ifndef LIBPORG_PATHLIST_H
+#define LIBPORG_PATHLIST_H
+
+#include "config.h"
+#include <string>
+#include <vector>
+
+
+namespace Porg {
+
+//
+// A colon separated list of paths, compiled once to match many paths
+// against it (see in_paths()): The entries without wildcards are kept
+// sorted, to be looked up for each parent directory of the path, and
+// only the entries with wildcards are passed to fnmatch().
+//
+class PathList
+{
+	public:
+
+	explicit PathList(std::string const& list = "");
+
+	bool match(std::string const& path) const;
+
+	// the list as given, and with empty entries, and trailing and
+	// repeated slashes removed
+	std::string const& list() const		{ return m_list; }
+	std::string const& str() const		{ return m_str; }
+
+	private:
+
+	std::string					m_list;
+	std::string					m_str;
+	bool						m_all;		// "/" is in the list
+	std::vector<std::string>	m_literals;
+	std::vector<std::string>	m_globs;
+
+	bool is_literal(std::string const& path, std::string::size_type len) const;
+
+};	// class PathList
+
+}	// namespace Porg
+
+
+#endif  // LIBPORG_PATHLIST_H
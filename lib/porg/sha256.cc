@@ -0,0 +1,153 @@
+//=======================================================================
+// sha256.cc
+//-----------------------------------------------------------------------
+// This file is part of the package porg
+// Copyright (C) 2015 David Ricart
+// For more information visit http://porg.sourceforge.net
+//=======================================================================
+
+#include "config.h"
+#include "sha256.h"
+#include <algorithm>
+#include <fcntl.h>
+
+using std::string;
+using namespace Porg;
+
+
+static uint32_t const s_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+
+static inline uint32_t rotr(uint32_t x, int n)
+{
+	return (x >> n) | (x << (32 - n));
+}
+
+
+Sha256::Sha256()
+:
+	m_len(0),
+	m_used(0)
+{
+	static uint32_t const init[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+		0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+	};
+
+	memcpy(m_state, init, sizeof(m_state));
+}
+
+
+void Sha256::transform(uint8_t const* block)
+{
+	uint32_t w[64];
+
+	for (int i = 0; i < 16; ++i)
+		w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16
+			| (uint32_t)block[i * 4 + 2] << 8 | block[i * 4 + 3];
+
+	for (int i = 16; i < 64; ++i) {
+		uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+
+	uint32_t a = m_state[0], b = m_state[1], c = m_state[2], d = m_state[3];
+	uint32_t e = m_state[4], f = m_state[5], g = m_state[6], h = m_state[7];
+
+	for (int i = 0; i < 64; ++i) {
+		uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25))
+			+ ((e & f) ^ (~e & g)) + s_k[i] + w[i];
+		uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22))
+			+ ((a & b) ^ (a & c) ^ (b & c));
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+
+	m_state[0] += a; m_state[1] += b; m_state[2] += c; m_state[3] += d;
+	m_state[4] += e; m_state[5] += f; m_state[6] += g; m_state[7] += h;
+}
+
+
+void Sha256::update(void const* data, size_t len)
+{
+	uint8_t const* p = static_cast<uint8_t const*>(data);
+
+	m_len += len;
+
+	if (m_used) {
+		size_t n = std::min(len, sizeof(m_block) - m_used);
+		memcpy(m_block + m_used, p, n);
+		m_used += n;
+		p += n;
+		len -= n;
+		if (m_used < sizeof(m_block))
+			return;
+		transform(m_block);
+		m_used = 0;
+	}
+
+	for ( ; len >= sizeof(m_block); p += sizeof(m_block), len -= sizeof(m_block))
+		transform(p);
+
+	memcpy(m_block, p, len);
+	m_used = len;
+}
+
+
+//
+// Finish the digest and return it in hexadecimal.
+//
+string Sha256::hex()
+{
+	uint64_t bits = m_len * 8;
+	uint8_t pad[72] = { 0x80 };
+	size_t npad = (m_used < 56 ? 56 : 120) - m_used;
+
+	for (int i = 0; i < 8; ++i)
+		pad[npad + i] = bits >> (56 - i * 8);
+
+	update(pad, npad + 8);
+
+	char const digits[] = "0123456789abcdef";
+	string ret;
+
+	for (int i = 0; i < 8; ++i) {
+		for (int j = 28; j >= 0; j -= 4)
+			ret += digits[(m_state[i] >> j) & 0xf];
+	}
+
+	return ret;
+}
+
+
+string Sha256::file(string const& path)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return "";
+
+	Sha256 sha;
+	char buf[65536];
+	ssize_t cnt;
+
+	while ((cnt = read(fd, buf, sizeof(buf))) != 0) {
+		if (cnt > 0)
+			sha.update(buf, cnt);
+		else if (errno != EINTR)
+			break;
+	}
+
+	close(fd);
+
+	return cnt ? "" : sha.hex();
+}
@@ -0,0 +1,49 @@
+//=======================================================================
+// sha256.h
+//-----------------------------------------------------------------------
+// This file is part of the package porg
+// Copyright (C) 2015 David Ricart
+// For more information visit http://porg.sourceforge.net
+//=======================================================================
+
+#ifndef LIBPORG_SHA256_H
+#define LIBPORG_SHA256_H
+
+#include "config.h"
+#include <string>
+#include <stdint.h>
+
+
+namespace Porg {
+
+//
+// SHA-256 message digest (FIPS 180-4), used for the checksums of the
+// logged files.
+//
+class Sha256
+{
+	public:
+
+	Sha256();
+
+	void update(void const* data, size_t len);
+	std::string hex();
+
+	// checksum of a file, or an empty string on error
+	static std::string file(std::string const& path);
+
+	private:
+
+	uint32_t	m_state[8];
+	uint64_t	m_len;		// bytes processed
+	uint8_t		m_block[64];
+	size_t		m_used;		// bytes in m_block
+
+	void transform(uint8_t const* block);
+
+};	// class Sha256
+
+}	// namespace Porg
+
+
+#endif  // LIBPORG_SHA256_H
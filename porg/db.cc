@@ -7,7 +7,6 @@
 //=======================================================================
 
 #include "config.h"
-#include "porg/file.h"
 #include "db.h"
 #include "util.h"
 #include "main.h"
@@ -128,7 +127,7 @@ int DB::get_file_size_width() const
 
 	for (const_iterator p(begin()); p != end(); ++p) {
 		for (Pkg::const_iter f((*p)->files().begin()); f != (*p)->files().end(); ++f)
-			size_w = max(size_w, get_width((*f)->size()));
+			size_w = max(size_w, get_width(f->size()));
 	}
 
 	return size_w;
@@ -0,0 +1,318 @@
+//=======================================================================
+// fanotify.cc
+//-----------------------------------------------------------------------
+// This file is part of the package porg
+// Copyright (C) 2015 David Ricart
+// For more information visit http://porg.sourceforge.net
+//=======================================================================
+
+#include "config.h"
+#include "fanotify.h"
+
+#if PORG_FANOTIFY
+
+#include "out.h"
+#include "opt.h"
+#include "main.h"			// g_exit_status
+#include "porg/common.h"
+#include "porg-log/event.h"
+#include <sstream>
+#include <algorithm>
+#include <fcntl.h>
+#include <mntent.h>
+#include <poll.h>
+#include <sys/fanotify.h>
+#include <sys/statfs.h>
+#include <sys/wait.h>
+
+using std::string;
+using std::vector;
+using std::map;
+using namespace Porg;
+
+static bool logged(string const& path);
+
+
+Fanotify::Fanotify(int fd)
+:
+	Tracer(fd, "fanotify"),
+	m_fanotify(-1),
+	m_mounts(),
+	m_dirs()
+{
+	m_fanotify = fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME
+		| FAN_CLOEXEC | FAN_NONBLOCK | FAN_UNLIMITED_QUEUE, O_RDONLY);
+
+	if (m_fanotify < 0)
+		throw Error("fanotify_init()", errno);
+
+	// mark the filesystems of the included paths (the parts of them
+	// before any wildcard), and of the mount points under them
+
+	std::istringstream is(Opt::include() + ":");
+
+	for (string path; getline(is, path, ':'); ) {
+		
+		if (path.empty())
+			continue;
+		
+		string::size_type w = path.find_first_of("*?[");
+		if (w != string::npos)
+			path.erase(path.rfind('/', w) + 1);
+
+		// a path not created yet is in the filesystem of its parent
+		for (struct stat s; path.size() > 1 && lstat(path.c_str(), &s) < 0; )
+			path.erase(std::max<string::size_type>(path.rfind('/'), 1));
+		
+		mark(path, true);
+	}
+
+	FILE* f = setmntent("/proc/self/mounts", "r");
+	
+	for (mntent* m; f && (m = getmntent(f)); ) {
+		if (Opt::include_paths().match(m->mnt_dir)
+		&& !Opt::exclude_paths().match(m->mnt_dir))
+			mark(m->mnt_dir, false);
+	}
+
+	if (f)
+		endmntent(f);
+}
+
+
+Fanotify::~Fanotify()
+{
+	for (map<fsid_t, int>::iterator p = m_mounts.begin(); p != m_mounts.end(); ++p)
+		close(p->second);
+
+	if (m_fanotify >= 0)
+		close(m_fanotify);
+}
+
+
+//
+// Mark the whole filesystem mounted at path, and keep a descriptor of it to
+// open the file handles of its directories.
+// Filesystems not supporting file handles (like /proc) can't be marked.
+//
+void Fanotify::mark(string const& path, bool required)
+{
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	struct statfs s;
+	
+	if (fd < 0 || fstatfs(fd, &s) < 0 || fanotify_mark(m_fanotify, 
+		FAN_MARK_ADD | FAN_MARK_FILESYSTEM, FAN_CREATE | FAN_CLOSE_WRITE 
+		| FAN_DELETE | FAN_RENAME | FAN_ONDIR, fd, 0) < 0) {
+		
+		int errno_ = errno;
+		if (fd >= 0)
+			close(fd);
+		if (required)
+			throw Error("fanotify_mark(" + path + ")", errno_);
+		return;
+	}
+
+	fsid_t fsid;
+	memcpy(&fsid.first, &s.f_fsid, sizeof(int));
+	memcpy(&fsid.second, reinterpret_cast<char*>(&s.f_fsid) + sizeof(int), sizeof(int));
+
+	if (m_mounts.insert(std::make_pair(fsid, fd)).second)
+		Out::dbg("fanotify :: watching " + path);
+	else
+		close(fd);
+}
+
+
+//
+// Log the events until the command exits. Unlike the other methods, every
+// change under the included paths is logged, whichever the process that
+// made it (except porg itself). Return the wait status of the command.
+//
+int Fanotify::supervise(pid_t pid)
+{
+	bool exited = false;
+	int status = 0;
+
+	while (!exited) {
+
+		pollfd p = { m_fanotify, POLLIN, 0 };
+		
+		if (poll(&p, 1, 50) < 0 && errno != EINTR)
+			throw Error("poll()", errno);
+
+		while (read_events()) ;
+
+		if (waitpid(pid, &status, WNOHANG) == pid)
+			exited = true;
+	}
+
+	// the events of the command are queued before it exits
+
+	while (read_events()) ;
+
+	flush();
+
+	return status;
+}
+
+
+//
+// Read and handle the queued events.
+// Return false if the queue is empty.
+//
+bool Fanotify::read_events()
+{
+	// buffer aligned for the event records
+	union { char buf[64 * 1024]; fanotify_event_metadata m; } u;
+	
+	ssize_t cnt = read(m_fanotify, u.buf, sizeof(u.buf));
+
+	if (cnt < 0) {
+		if (errno == EAGAIN || errno == EINTR)
+			return errno == EINTR;
+		throw Error("read(fanotify)", errno);
+	}
+
+	for (fanotify_event_metadata* ev = &u.m; FAN_EVENT_OK(ev, cnt); 
+		ev = FAN_EVENT_NEXT(ev, cnt)) {
+
+		if (ev->vers != FANOTIFY_METADATA_VERSION)
+			throw Error("fanotify: Unsupported metadata version");
+
+		else if (ev->mask & FAN_Q_OVERFLOW) {
+			Out::vrb("porg: fanotify: Event queue overflow (some files may not be logged)");
+			g_exit_status = EXIT_FAILURE;
+		}
+
+		else if (ev->pid != getpid())
+			handle(ev);
+	}
+
+	if (m_buf.size() >= BUFSIZE)
+		flush();
+
+	return true;
+}
+
+
+//
+// Log an event. Events on the same file may be merged, so that a single
+// event may report e.g. both the creation and the removal of a file.
+//
+void Fanotify::handle(fanotify_event_metadata const* ev)
+{
+	char const* const end = reinterpret_cast<char const*>(ev) + ev->event_len;
+	string path, oldpath;
+
+	for (char const* p = reinterpret_cast<char const*>(ev) + ev->metadata_len; 
+		p + sizeof(fanotify_event_info_header) <= end; ) {
+
+		fanotify_event_info_fid const* info = 
+			reinterpret_cast<fanotify_event_info_fid const*>(p);
+
+		if (!info->hdr.len)
+			break;
+		else if (info->hdr.info_type == FAN_EVENT_INFO_TYPE_OLD_DFID_NAME)
+			oldpath = get_path(info);
+		else if (info->hdr.info_type == FAN_EVENT_INFO_TYPE_DFID_NAME
+		|| info->hdr.info_type == FAN_EVENT_INFO_TYPE_NEW_DFID_NAME)
+			path = get_path(info);
+
+		p += info->hdr.len;
+	}
+
+	bool const ondir = ev->mask & FAN_ONDIR;
+	int const rm_op = ondir ? PORG_OP_RMDIR : PORG_OP_UNLINK;
+
+	// paths of directories change when they are renamed or removed
+	if (ondir && (ev->mask & (FAN_RENAME | FAN_DELETE)))
+		m_dirs.clear();
+
+	if (ev->mask & FAN_RENAME) {
+		// moved from an unknown place, taken as created
+		if (logged(path) && oldpath.empty())
+			log(ondir ? PORG_OP_MKDIR : PORG_OP_CREAT, ev->pid,
+				ondir ? 0 : O_CREAT | O_WRONLY, path);
+		else if (logged(path))
+			log_rename(ev->pid, oldpath, path);
+		else if (logged(oldpath))
+			log(rm_op, ev->pid, 0, oldpath);
+		return;
+	}
+	
+	else if (!logged(path))
+		return;
+
+	struct stat s;
+	bool const removed_first = (ev->mask & FAN_DELETE) && !lstat(path.c_str(), &s);
+
+	if (removed_first)
+		log(rm_op, ev->pid, 0, path);
+
+	if (ev->mask & FAN_CREATE)
+		log(ondir ? PORG_OP_MKDIR : PORG_OP_CREAT, ev->pid, 
+			ondir ? 0 : O_CREAT | O_WRONLY, path);
+
+	if (ev->mask & FAN_CLOSE_WRITE)
+		log(PORG_OP_OPEN, ev->pid, O_WRONLY, path);
+
+	if ((ev->mask & FAN_DELETE) && !removed_first)
+		log(rm_op, ev->pid, 0, path);
+}
+
+
+//
+// Get the path of the entry reported by a DFID_NAME record: Open the
+// directory by its handle, and append the name to its path.
+// Return an empty string on error (e.g. if the directory has been removed).
+//
+string Fanotify::get_path(fanotify_event_info_fid const* info)
+{
+	file_handle const* fh = reinterpret_cast<file_handle const*>(info->handle);
+	char const* name = reinterpret_cast<char const*>(fh->f_handle + fh->handle_bytes);
+	string key(reinterpret_cast<char const*>(&info->fsid), 
+		sizeof(info->fsid) + sizeof(file_handle) + fh->handle_bytes);
+	
+	map<string, string>::iterator p = m_dirs.find(key);
+
+	if (p == m_dirs.end()) {
+
+		fsid_t fsid;
+		memcpy(&fsid.first, &info->fsid, sizeof(int));
+		memcpy(&fsid.second, reinterpret_cast<char const*>(&info->fsid) + sizeof(int), sizeof(int));
+		
+		map<fsid_t, int>::iterator m = m_mounts.find(fsid);
+		if (m == m_mounts.end())
+			return "";
+
+		// copy the handle to get it aligned
+		vector<char> handle(key.begin() + sizeof(info->fsid), key.end());
+		int fd = open_by_handle_at(m->second, 
+			reinterpret_cast<file_handle*>(&handle[0]), O_PATH | O_CLOEXEC);
+		if (fd < 0)
+			return "";
+
+		string dir(read_link("/proc/self/fd/" + num2str(fd)));
+		close(fd);
+
+		if (dir.empty() || dir[0] != '/')
+			return "";
+		
+		p = m_dirs.insert(std::make_pair(key, dir == "/" ? "" : dir)).first;
+	}
+
+	return strcmp(name, ".") ? p->second + "/" + name : p->second;
+}
+
+
+//
+// Whether path is to be logged, according to the include and exclude lists.
+//
+static bool logged(string const& path)
+{
+	return !path.empty() && Opt::include_paths().match(path)
+		&& !Opt::exclude_paths().match(path);
+}
+
+
+#endif	// PORG_FANOTIFY
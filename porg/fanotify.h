@@ -0,0 +1,65 @@
+//=======================================================================
+// fanotify.h
+//-----------------------------------------------------------------------
+// This file is part of the package porg
+// Copyright (C) 2015 David Ricart
+// For more information visit http://porg.sourceforge.net
+//=======================================================================
+
+#ifndef PORG_FANOTIFY_H
+#define PORG_FANOTIFY_H
+
+#include "config.h"
+
+#if HAVE_SYS_FANOTIFY_H && HAVE_DECL_FAN_REPORT_DFID_NAME \
+	&& HAVE_DECL_FAN_RENAME && HAVE_OPEN_BY_HANDLE_AT
+#	define PORG_FANOTIFY 1
+#endif
+
+#if PORG_FANOTIFY
+
+#include "tracer.h"
+#include <map>
+
+struct fanotify_event_metadata;
+struct fanotify_event_info_fid;
+
+
+namespace Porg {
+
+//
+// Tracer based on fanotify: porg watches the filesystems of the included
+// paths, and logs the files and directories created, written, renamed or
+// removed in them (by any process) while the command runs.
+// The command runs untouched, so it works with statically linked programs,
+// and with programs run through setuid binaries, too.
+//
+class Fanotify : public Tracer
+{
+	public:
+
+	Fanotify(int fd);
+	~Fanotify();
+
+	int supervise(pid_t pid);
+
+	private:
+
+	typedef std::pair<int, int> fsid_t;
+
+	int								m_fanotify;
+	std::map<fsid_t, int>			m_mounts;	// to open the file handles
+	std::map<std::string, std::string>	m_dirs;	// handle -> path cache
+
+	void mark(std::string const& path, bool required);
+	bool read_events();
+	void handle(fanotify_event_metadata const*);
+	std::string get_path(fanotify_event_info_fid const*);
+
+};	// class Fanotify
+
+}	// namespace Porg
+
+#endif	// PORG_FANOTIFY
+
+#endif	// PORG_FANOTIFY_H
@@ -9,33 +9,259 @@
 #include "config.h"
 #include "out.h"
 #include "opt.h"
-#include "porg/common.h"	// in_paths()
+#include "porg/common.h"
+#include "porg-log/event.h"
 #include "util.h"
 #include "pkg.h"
 #include "newpkg.h"
+#include "main.h"			// g_exit_status
 #include "logger.h"
+#include "seccomp.h"
+#include "fanotify.h"
+#include "porg/sha256.h"
 #include <fstream>
-#include <iterator>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <vector>
 #include <glob.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
 #include <sys/wait.h>
 
 using namespace Porg;
 using namespace std;
 
 static string search_libporg();
+static void erase_tree(set<string>&, string const&);
+static void rename_tree(set<string>&, string const&, string const&);
+static void add_tree(string const&, vector<string>&);
+static bool is_newer(timespec const&, timespec const&);
 static void set_env(char const* var, string const& val);
+static void exec_shell(string const& command, string const& title);
 
 
-Logger::Logger()
+//
+// The loggers of a batch of packages.
+//
+class Logger::Batch : public vector<Logger*>
+{
+	public:
+	~Batch() { for (iterator p(begin()); p != end(); delete *p++) ; }
+};
+
+
+Logger::Logger(string const& pkgname, string const& command)
 :
-	m_pkgname(Opt::log_pkg_name()),
-	m_files()
+	m_pkgname(pkgname),
+	m_command(command),
+	m_pid(-1),
+	m_status(0),
+	m_files(),
+	m_dirs(),
+	m_renamed(),
+	m_fd(-1),
+	m_fd_path(),
+	m_tmpfile(),
+	m_traced(false),
+	m_stats(),
+	m_nstats(0),
+	m_checksums(),
+	m_channel(),
+	m_read(0),
+	m_corrupted(false),
+	m_events(),
+	m_moved(),
+	m_checked(),
+	m_checked_dirs()
+{ }
+
+
+Logger::~Logger()
 {
+	close_channel();
+}
+
+
+void Logger::run()
+{
+	if (!Opt::log_batch_file().empty()) {
+		run_batch();
+		return;
+	}
+
+	string command;
+		
+	for (uint i(0); i < Opt::args().size(); ++i)
+		command += Opt::args()[i] + " ";
+
+	Logger log(Opt::log_pkg_name(), command);
+
 	if (Opt::args().empty())
-		read_files_from_stream(cin);
+		log.read_files_from_stream(cin);
 	else
-		read_files_from_command();
+		log.read_files_from_command();
+
+	log.write_files();
+}
+
+
+//
+// Log the packages listed in the batch file: Run their commands (several
+// at a time, each traced through its own channel), then write the logs,
+// and report the exit status of each command.
+// Only the commands traced by libporg-log run concurrently, as the other
+// methods supervise one command at a time.
+//
+void Logger::run_batch()
+{
+	Batch batch;
+	read_batch_file(batch);
+
+	long jobs = Opt::log_jobs();
+	if (Opt::log_method() != METHOD_PRELOAD)
+		jobs = 1;
+	else if (jobs < 1 && (jobs = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+		jobs = 1;
+
+	for (size_t next = 0; ; ) {
+
+		long nrunning = 0;
+
+		for (size_t i = 0; i < next; ++i) {
+			if (!batch[i]->running())
+				continue;
+			else if (batch[i]->watch_channel())
+				nrunning++;
+			else
+				batch[i]->end_command();
+		}
+
+		while (next < batch.size() && nrunning < jobs) {
+			Out::vrb("Running the command of '" + batch[next]->m_pkgname + "'");
+			try 
+			{
+				batch[next]->start_command();
+			}
+			catch (std::exception const& x) 
+			{
+				// the package can't be logged
+				cerr << "porg: " << batch[next]->m_pkgname << ": " << x.what() << '\n';
+				g_exit_status = EXIT_FAILURE;
+				delete batch[next];
+				batch.erase(batch.begin() + next);
+				continue;
+			}
+			if (batch[next]->running())
+				nrunning++;
+			else
+				batch[next]->end_command();
+			++next;
+		}
+
+		if (!nrunning && next == batch.size())
+			break;
+
+		poll(0, 0, 20);
+	}
+
+	// a path moved by a command may be in the paths logged by the others
+	// that ran at the same time, as resolved by watch_channel()
+
+	if (jobs > 1 && batch.size() > 1) {
+		set<string> moved;
+		for (size_t i = 0; i < batch.size(); ++i)
+			moved.insert(batch[i]->m_moved.begin(), batch[i]->m_moved.end());
+		for (size_t i = 0; i < batch.size(); ++i)
+			batch[i]->m_moved = moved;
+	}
+
+	// write the logs once all the commands are done
+
+	for (size_t i = 0; i < batch.size(); ++i) {
+		try 
+		{
+			batch[i]->write_files();
+		}
+		catch (std::exception const& x) 
+		{
+			cerr << "porg: " << x.what() << '\n';
+			g_exit_status = EXIT_FAILURE;
+		}
+	}
+
+	for (size_t i = 0; i < batch.size(); ++i) {
+		cout << batch[i]->m_pkgname << ": " << batch[i]->status() << '\n';
+		if (batch[i]->m_status)
+			g_exit_status = EXIT_FAILURE;
+	}
+}
+
+
+//
+// Read the packages to be logged from the batch file, one per line: The
+// name of the package, and the command that installs it. Empty lines and
+// lines beginning with '#' are skipped.
+//
+void Logger::read_batch_file(Batch& batch)
+{
+	string const& path(Opt::log_batch_file());
+	std::ifstream file;
+	
+	if (path != "-") {
+		file.open(path.c_str());
+		if (!file)
+			throw Error(path, errno);
+	}
+
+	istream& is = path == "-" ? cin : file;
+	set<string> names;
+	uint nline = 0;
+
+	for (string buf; getline(is, buf); ) {
+		
+		nline++;
 
+		string name, command;
+		std::istringstream line(buf);
+		
+		if (!(line >> name) || name[0] == '#')
+			continue;
+
+		getline(line >> std::ws, command);
+		name = to_lower(name);
+
+		string const where(path + ":" + num2str(nline) + ": ");
+
+		if (command.empty())
+			throw Error(where + "No command for package '" + name + "'");
+		else if (!names.insert(name).second)
+			throw Error(where + "Package '" + name + "' listed twice");
+
+		batch.push_back(new Logger(name, command));
+	}
+
+	if (batch.empty())
+		throw Error(path + ": No packages to log");
+}
+
+
+//
+// Describe the wait status of the command.
+//
+string Logger::status() const
+{
+	if (WIFSIGNALED(m_status))
+		return "killed by signal " + num2str(WTERMSIG(m_status));
+	else
+		return "exit status " + num2str(WEXITSTATUS(m_status));
+}
+
+
+void Logger::write_files()
+{
 	filter_files();
 
 	if (m_pkgname.empty())
@@ -45,96 +271,632 @@ Logger::Logger()
 }
 
 
-void Logger::run()
+//
+// Register the package with the files checked by filter_files() (and
+// their lstat()).
+//
+void Logger::write_files_to_pkg()
 {
-	static Logger log;
-}
+	// created directories are known only when the command is traced
+	vector<string> const* dirs = m_traced ? &m_checked_dirs : 0;
+	bool logged = false;
 
+	if (Out::debug()) {
+		Out::dbg_title("logged files");
+		write_files_to_stream(cerr);
+		Out::dbg_title();
+	}
 
-void Logger::write_files_to_pkg() const
-{
-	bool done = false;
+	if (Opt::log_checksums()) {
+		for (vector<CheckedPath>::iterator c = m_checked.begin(); c != m_checked.end(); ++c)
+			c->digest = get_checksum(*c);
+	}
 
 	if (Opt::log_append()) {
 		try 
 		{
 			Pkg already_logged_pkg(m_pkgname);
-			already_logged_pkg.append(m_files);
-			done = true;
+			logged = true;
+			already_logged_pkg.append(m_checked, dirs);
+		}
+		catch (...) 
+		{
+			if (logged)
+				throw;
 		}
-		catch (...) { }
 	}
 
-	if (!done)
-		NewPkg newpkg(m_pkgname, m_files);
+	if (!logged)
+		NewPkg newpkg(m_pkgname, m_checked, dirs);
 
-	if (Out::debug()) {
-		Out::dbg_title("logged files");
-		write_files_to_stream(cerr);
-		Out::dbg_title();
-	}
+	vector<CheckedPath>().swap(m_checked);
 }
 
 
 void Logger::write_files_to_stream(ostream& s) const
 {
-	copy(m_files.begin(), m_files.end(), ostream_iterator<string>(s, "\n"));
+	for (vector<CheckedPath>::const_iterator c = m_checked.begin(); c != m_checked.end(); ++c)
+		s << c->path << '\n';
 }
 
 
 void Logger::read_files_from_stream(istream& f)
 {
-	for (string buf; getline(f, buf); m_files.insert(buf)) ;
+	for (string buf; getline(f, buf); m_files.push_back(buf)) ;
 }
 
 
 void Logger::read_files_from_command()
 {
-	// get name for tmp file
+	start_command();
+
+	while (running()) {
+		poll(0, 0, 20);
+		watch_channel();
+	}
+
+	end_command();
+}
+
+
+//
+// Start running the command. Unless it runs traced by libporg-log, wait for
+// it to finish.
+//
+void Logger::start_command()
+{
+	if (Opt::log_method() == METHOD_MANIFEST && read_files_from_manifest())
+		return;
+
+	m_traced = true;
+
+	open_channel();
+	exec_command();
+}
+
+
+//
+// Once the command is done, get the logged files from the channel.
+//
+void Logger::end_command()
+{
+	if (!m_traced)
+		return;
+
+	read_files_from_channel();
+	print_stats();
+	close_channel();
+}
+
+
+//
+// Build directories of the build systems that write a list of the installed
+// files, and the path of the list relative to them.
+//
+static struct {
+	char const* tag;	// file that identifies the build directory
+	char const* manifest;
+} const s_manifests[] = {
+	{ "CMakeCache.txt",				"install_manifest.txt" },
+	{ "meson-private/coredata.dat",	"meson-logs/install-log.txt" },
+};
+
+
+//
+// If a CMake or Meson build directory is found the way NewPkg looks for the
+// .spec or .pc files, run the command untraced, and read the files from the
+// install manifest written by it.
+// If the command does not write the manifest (it may not run the install
+// target), nothing can be logged, as the command did not run traced.
+// Return false (without running the command) if no build directory is found.
+//
+bool Logger::read_files_from_manifest()
+{
+	string manifest;
+
+	for (uint i = 0; i < sizeof(s_manifests) / sizeof(s_manifests[0]); ++i) {
+		string tag(search_file(s_manifests[i].tag));
+		if (!tag.empty()) {
+			manifest = tag.substr(0, tag.size() - strlen(s_manifests[i].tag))
+				+ s_manifests[i].manifest;
+			break;
+		}
+	}
+
+	if (manifest.empty()) {
+		Out::dbg("No install manifest found, tracing the command");
+		return false;
+	}
+
+	// the file timestamps are taken from the coarse clock, which may be
+	// a bit behind the precise one
+	timespec start;
+#ifdef CLOCK_REALTIME_COARSE
+	clock_gettime(CLOCK_REALTIME_COARSE, &start);
+#else
+	clock_gettime(CLOCK_REALTIME, &start);
+#endif
+
+	pid_t pid = fork();
+
+	if (pid == 0) { // child
+		Out::dbg_title("settings");
+		Out::dbg("method = manifest (" + manifest + ")");
+		exec_shell(m_command, "manifest");
+	}
+
+	else if (pid == -1)
+		throw Error("fork()", errno);
+
+	waitpid(pid, &m_status, 0);
+
+	// skip a manifest left by a former installation
+
+	struct stat s;
+	std::ifstream f(manifest.c_str());
+
+	if (stat(manifest.c_str(), &s) < 0 || !is_newer(s.st_mtim, start) || !f)
+		throw Error(manifest + ": Install manifest not written by the command "
+			"(run it again with '-M preload' to log the package)");
+
+	Out::dbg("Reading " + manifest);
+
+	for (string buf; getline(f, buf); ) {
+		if (!buf.empty() && buf[0] != '#')
+			m_files.push_back(buf);
+	}
+
+	return true;
+}
+
+
+//
+// Create the channel through which libporg-log sends the logged files.
+// It is an anonymous memfd, or an (unlinked, if possible) tmp file in systems
+// without memfd_create(), inherited by the command as an open descriptor
+// in append mode, so that libporg-log does not need to open it by path.
+// It is opened close-on-exec, so that it does not leak into the commands
+// of other jobs, nor into the programs run by the seccomp or fanotify
+// supervisors.
+// It begins with a porg_channel header, mapped in memory by libporg-log.
+//
+void Logger::open_channel()
+{
+#if HAVE_MEMFD_CREATE
+	m_fd = memfd_create("porg", MFD_CLOEXEC);
+#endif
+
+	if (m_fd < 0) {
+		
+		char* tmpdir = getenv("TMPDIR");
+		char tmpfile[4096];
+
+		snprintf(tmpfile, sizeof(tmpfile), "%s/porgXXXXXX", tmpdir ? tmpdir : "/tmp");
+	
+		if ((m_fd = mkstemp(tmpfile)) < 0)
+			throw Error("mkstemp()", errno);
+		else if (fcntl(m_fd, F_SETFD, FD_CLOEXEC) < 0)
+			throw Error("fcntl()", errno);
+
+		m_tmpfile = tmpfile;
+	}
+
+	if (fcntl(m_fd, F_SETFL, O_APPEND) < 0)
+		throw Error("fcntl()", errno);
+
+	// header of the channel, shared by the traced processes
+
+	porg_channel header;
+	memset(&header, 0, sizeof(header));
+	
+	if (write(m_fd, &header, sizeof(header)) != sizeof(header))
+		throw Error("write()", errno);
+
+	m_read = sizeof(header);
+	
+	// path to reopen the channel, for commands that close inherited descriptors
+
+	struct stat s;
+
+	if (!stat("/proc/self/fd", &s)) {
+		m_fd_path = "/proc/" + num2str(getpid()) + "/fd/" + num2str(m_fd);
+		if (!m_tmpfile.empty()) {
+			unlink(m_tmpfile.c_str());
+			m_tmpfile.clear();
+		}
+	}
+	else
+		m_fd_path = m_tmpfile;
+}
+
+
+void Logger::close_channel()
+{
+	if (m_fd >= 0)
+		close(m_fd);
+
+	if (!m_tmpfile.empty())
+		unlink(m_tmpfile.c_str());
+	
+	m_fd = -1;
+	m_tmpfile.clear();
+}
+
+
+//
+// Read the records written to the channel since the last call, a chunk at a
+// time, and take each one as it comes (see add_event()). Only the last
+// record, if not complete yet, is kept for the next call.
+//
+void Logger::read_channel()
+{
+	size_t const CHUNK = 1 << 20;
+	struct stat s;
+
+	if (m_corrupted)
+		return;
+	else if (fstat(m_fd, &s) < 0)
+		throw Error("fstat()", errno);
+
+	while (m_read < s.st_size) {
+
+		size_t const tail = m_channel.size();
+		size_t const len = std::min<off_t>(CHUNK, s.st_size - m_read);
+
+		m_channel.resize(tail + len);
+
+		for (ssize_t cnt, done = 0; done < (ssize_t)len; done += cnt) {
+			if ((cnt = pread(m_fd, &m_channel[tail + done], len - done, m_read + done)) <= 0) {
+				if (cnt < 0 && errno == EINTR)
+					cnt = 0;
+				else
+					throw Error("read()", cnt < 0 ? errno : EIO);
+			}
+		}
+
+		m_read += len;
+
+		porg_event ev;
+		size_t off = 0;
+
+		for ( ; off + sizeof(ev) <= m_channel.size(); off += ev.size) {
+
+			memcpy(&ev, &m_channel[off], sizeof(ev));
+
+			if (ev.size < PORG_EVENT_SIZE(ev.path_len, ev.path2_len)) {
+				Out::vrb("porg: Corrupted event record in the channel");
+				g_exit_status = EXIT_FAILURE;
+				m_corrupted = true;
+				vector<char>().swap(m_channel);
+				return;
+			}
+			else if (ev.size > m_channel.size() - off)
+				break;
+
+			char const* rec = &m_channel[off + sizeof(ev)];
+			add_event(ev, string(rec, ev.path_len), string(rec + ev.path_len, ev.path2_len));
+		}
+
+		m_channel.erase(m_channel.begin(), m_channel.begin() + off);
+	}
+}
+
+
+//
+// Once the command is done, take the records left in the channel, and
+// apply the renames and removals.
+//
+void Logger::read_files_from_channel()
+{
+	read_channel();
+
+	if (!m_channel.empty() && !m_corrupted) {
+		Out::vrb("porg: Truncated event record in the channel");
+		g_exit_status = EXIT_FAILURE;
+	}
+
+	vector<char>().swap(m_channel);
+
+	// the directories resolved while the command ran may have changed since
+	forget_real_dirs();
+
+	apply_events();
+	add_renamed_dirs();
+}
+
+
+//
+// Take a record read from the channel: Add the logged files, resolved right
+// away, to be checked by filter_files() once the command is done. Compute
+// the checksum of each file as soon as it is closed, while its data is
+// likely still cached. Keep the renames, removals and created directories,
+// to be applied in order by apply_events().
+// The files renamed or removed are not taken out of m_files, as the ones
+// that are gone are skipped by filter_files() anyway, and the contents of
+// the renamed directories are added by add_renamed_dirs().
+//
+void Logger::add_event(porg_event const& ev, string const& path, string const& path2)
+{
+	string real;
+
+	switch (ev.op) {
+
+		case PORG_OP_CLOSE:
+			if (Opt::log_checksums())
+				add_checksum(path);
+			return;
+
+		case PORG_OP_STATS:
+			add_stats(path, ev.flags);
+			return;
+
+		case PORG_OP_RENAME:
+			m_moved.insert(clear_path(path2));
+			// fall through
+
+		case PORG_OP_SYMLINK:
+			// a symlink may replace a directory in the path of other files
+			m_moved.insert(real = clear_path(path));
+			m_files.push_back(real);
+			break;
+
+		case PORG_OP_OPEN:
+		case PORG_OP_CREAT:
+		case PORG_OP_LINK:
+			m_files.push_back(clear_path(path));
+			break;
+
+		case PORG_OP_UNLINK:
+		case PORG_OP_RMDIR:
+			m_moved.insert(clear_path(path));
+			break;
+	}
+
+	switch (ev.op) {
+
+		case PORG_OP_RENAME:
+		case PORG_OP_MKDIR:
+		case PORG_OP_UNLINK:
+		case PORG_OP_RMDIR: {
+			Event e = { ev.time, ev.op, path, path2 };
+			m_events.push_back(e);
+			break;
+		}
+	}
+}
+
+
+//
+// Apply the renames, removals and created directories to the created
+// directories, and to the renamed ones (see add_renamed_dirs()). Records
+// buffered by different processes may have reached the channel out of
+// order, so they are sorted by time (and then by position).
+//
+void Logger::apply_events()
+{
+	set<string> dirs;
+
+	std::stable_sort(m_events.begin(), m_events.end(),
+		[](Event const& a, Event const& b) { return a.time < b.time; });
+
+	for (vector<Event>::const_iterator e = m_events.begin(); e != m_events.end(); ++e) {
+
+		switch (e->op) {
+
+			case PORG_OP_RENAME:
+				rename_tree(dirs, e->path2, e->path);
+				rename_tree(m_renamed, e->path2, e->path);
+				m_renamed.insert(e->path);
+				break;
+
+			case PORG_OP_MKDIR:
+				dirs.insert(e->path);
+				break;
+
+			case PORG_OP_UNLINK:
+			case PORG_OP_RMDIR:
+				erase_tree(dirs, e->path);
+				erase_tree(m_renamed, e->path);
+				break;
+		}
+	}
+
+	vector<Event>().swap(m_events);
+	m_dirs.assign(dirs.begin(), dirs.end());
+}
+
+
+//
+// While the command runs, take the records written to the channel so far.
+// Return false once the command has exited.
+//
+bool Logger::watch_channel()
+{
+	if (!running())
+		return false;
+	
+	int ret = waitpid(m_pid, &m_status, WNOHANG);
+	
+	if (ret != 0 && !(ret < 0 && errno == EINTR))
+		m_pid = -1;
+
+	read_channel();
+
+	return running();
+}
+
+
+void Logger::add_checksum(string const& inpath)
+{
+	string path(clear_path(inpath));
+	struct stat s;
 
-	char* tmpdir = getenv("TMPDIR");
-	char tmpfile[4096];
+	if (lstat(path.c_str(), &s) < 0 || !S_ISREG(s.st_mode))
+		return;
 
-	snprintf(tmpfile, sizeof(tmpfile), "%s/porgXXXXXX", tmpdir ? tmpdir : "/tmp");
+	Checksum& sum = m_checksums[path];
 	
-	if (close(mkstemp(tmpfile)) < 0)
-		snprintf(tmpfile, sizeof(tmpfile), "/tmp/porg%d", getpid());
+	sum.digest = Sha256::file(path);
+	sum.size = s.st_size;
+	sum.mtime = s.st_mtime;
+	sum.ino = s.st_ino;
+}
 
-	// exec command
 
-	try
-	{
-		exec_command(tmpfile);
-		FileStream<ifstream> f(tmpfile);
-		read_files_from_stream(f);
-		unlink(tmpfile);
+//
+// Get the checksum of a logged file (empty if not a regular file): The one
+// computed when the file was closed, if it has not changed since (as seen by
+// the lstat() of filter_files()), or else computed now.
+//
+string Logger::get_checksum(CheckedPath const& file) const
+{
+	struct stat const& s(file.st);
+
+	if (!S_ISREG(s.st_mode))
+		return "";
+
+	map<string, Checksum>::const_iterator c = m_checksums.find(file.path);
+	
+	if (c != m_checksums.end() && c->second.size == s.st_size 
+	&& c->second.mtime == s.st_mtime && c->second.ino == s.st_ino)
+		return c->second.digest;
+	else
+		return Sha256::file(file.path);
+}
+
+
+//
+// Add the counters reported by a process (as name=value pairs), in one or
+// more records, the first one flagged.
+//
+void Logger::add_stats(string const& list, bool first)
+{
+	std::istringstream is(list);
+	
+	for (string buf; is >> buf; ) {
+		string::size_type p = buf.find('=');
+		if (p != string::npos)
+			m_stats[buf.substr(0, p)] += strtoull(buf.substr(p + 1).c_str(), 0, 10);
 	}
-	catch (...)
-	{
-		unlink(tmpfile);
-		throw;
+
+	if (first)
+		m_nstats++;
+}
+
+
+//
+// Print (with -v) a summary of the counters reported by libporg-log.
+//
+void Logger::print_stats() const
+{
+	if (!Out::verbose() || !m_nstats)
+		return;
+
+	// counters not related to a handler
+	char const* const stats[][2] = {
+		{ "events",		"events logged" },
+		{ "filtered",	"events filtered out" },
+		{ "duplicates",	"duplicate events" },
+		{ "bytes",		"bytes written" },
+		{ "nsecs",		"time in libporg-log (ns)" },
+	};
+	uint const nstats = sizeof(stats) / sizeof(stats[0]);
+	uint64_t calls = 0;
+	std::ostringstream hooks, os;
+
+	for (map<string, uint64_t>::const_iterator p = m_stats.begin(); p != m_stats.end(); ++p) {
+		uint i = 0;
+		while (i < nstats && p->first != stats[i][0])
+			++i;
+		if (i == nstats) {
+			calls += p->second;
+			hooks << "\n    " << std::left << setw(24) << p->first << p->second;
+		}
 	}
+
+	os << "libporg-log statistics (" << m_nstats << " programs):\n  " 
+		<< std::left << setw(26) << "intercepted calls" << calls << hooks.str();
+
+	for (uint i = 0; i < nstats; ++i) {
+		map<string, uint64_t>::const_iterator p = m_stats.find(stats[i][0]);
+		os << "\n  " << setw(26) << stats[i][1] << (p == m_stats.end() ? 0 : p->second);
+	}
+
+	Out::vrb(os.str());
 }
 
 
-void Logger::exec_command(string const& tmpfile) const
+//
+// Add the contents of the renamed directories, where they ended up after all
+// the events are applied. The installer does not have to walk them at every
+// rename.
+//
+void Logger::add_renamed_dirs()
 {
+	string last;
+	struct stat s;
+
+	for (set<string>::iterator p = m_renamed.begin(); p != m_renamed.end(); ++p) {
+		
+		// already added with its parent
+		if (!last.empty() && !p->compare(0, last.size() + 1, last + "/"))
+			continue;
+
+		if (!lstat(p->c_str(), &s) && S_ISDIR(s.st_mode)) {
+			add_tree(clear_path(*p), m_files);
+			last = *p;
+		}
+	}
+
+	m_renamed.clear();
+}
+
+
+void Logger::exec_command()
+{
+#if PORG_SECCOMP
+	if (Opt::log_method() == METHOD_SECCOMP) {
+		exec_command_seccomp();
+		return;
+	}
+#endif
+#if PORG_FANOTIFY
+	if (Opt::log_method() == METHOD_FANOTIFY) {
+		exec_command_fanotify();
+		return;
+	}
+#endif
+
+	struct stat s;
+
+	if (fstat(m_fd, &s) < 0)
+		throw Error("fstat()", errno);
+
 	pid_t pid = fork();
 
 	if (pid == 0) { // child
 
-		string command, libporg = search_libporg();
-		
-		for (uint i(0); i < Opt::args().size(); ++i)
-			command += Opt::args()[i] + " ";
+		string libporg = search_libporg();
+		string fd(num2str(m_fd) + ":" + num2str(s.st_dev) + ":" + num2str(s.st_ino));
 
+		// the channel is close-on-exec, so that only this command inherits it
+		if (fcntl(m_fd, F_SETFD, 0) < 0)
+			throw Error("fcntl()", errno);
+		
 #ifdef __APPLE__
 		set_env("DYLD_INSERT_LIBRARIES", libporg);
 		set_env("DYLD_FORCE_FLAT_NAMESPACE", "1");
 #else
 		set_env("LD_PRELOAD", libporg);
 #endif
-		set_env("PORG_TMPFILE", tmpfile);
+		set_env("PORG_FD", fd);
+		set_env("PORG_FD_PATH", m_fd_path);
+		set_env("PORG_INCLUDE", Opt::include_paths().str());
+		set_env("PORG_EXCLUDE", Opt::exclude_paths().str());
+		if (Opt::log_checksums())
+			set_env("PORG_CHECKSUMS", "yes");
+		if (Out::verbose())
+			set_env("PORG_STATS", "yes");
 		if (Out::debug())
 			set_env("PORG_DEBUG", "yes");
 
@@ -145,55 +907,333 @@ void Logger::exec_command(string const& tmpfile) const
 #else
 		Out::dbg("LD_PRELOAD = " + libporg); 
 #endif
-		Out::dbg("INCLUDE = " + Opt::include()); 
-		Out::dbg("EXCLUDE = " + Opt::exclude()); 
-		Out::dbg("command = " + command);
-		Out::dbg_title("libporg-log");
+		Out::dbg("PORG_FD = " + fd); 
+		Out::dbg("PORG_FD_PATH = " + m_fd_path); 
+		Out::dbg("PORG_INCLUDE = " + Opt::include_paths().str()); 
+		Out::dbg("PORG_EXCLUDE = " + Opt::exclude_paths().str()); 
+		
+		exec_shell(m_command, "libporg-log");
+	}
 
-		char* cmd[] = { (char*)"sh", (char*)"-c", (char*)(command.c_str()), 0 };
-		execv("/bin/sh", cmd);
+	else if (pid == -1)
+		throw Error("fork()", errno);
+
+	m_pid = pid;
+}
+
+
+#if PORG_SECCOMP
+
+//
+// Run the command under a seccomp filter, porg itself logging the files
+// to the channel.
+//
+void Logger::exec_command_seccomp()
+{
+	Seccomp seccomp(m_fd);
 
-		throw Error("execv()", errno);
+	pid_t pid = fork();
+
+	if (pid == 0) { // child
+		Out::dbg_title("settings");
+		Out::dbg("method = seccomp");
+		seccomp.install();
+		exec_shell(m_command, "seccomp");
 	}
 
 	else if (pid == -1)
 		throw Error("fork()", errno);
 
-	wait(0);
+	m_status = seccomp.supervise(pid);
 }
 
+#endif	// PORG_SECCOMP
+
+
+#if PORG_FANOTIFY
+
+//
+// Run the command while porg logs the changes in the filesystems of the
+// included paths.
+//
+void Logger::exec_command_fanotify()
+{
+	Fanotify fanotify(m_fd);
+
+	pid_t pid = fork();
+
+	if (pid == 0) { // child
+		Out::dbg_title("settings");
+		Out::dbg("method = fanotify");
+		exec_shell(m_command, "fanotify");
+	}
+
+	else if (pid == -1)
+		throw Error("fork()", errno);
+
+	m_status = fanotify.supervise(pid);
+}
+
+#endif	// PORG_FANOTIFY
+
+
+//
+// Paths checked by filter_files(), shared by its threads.
+//
+struct Logger::FilterJob
+{
+	Logger const*			logger;
+	vector<string const*> const*	paths;
+	vector<CheckedPath>*			results;
+	bool					dirs;	// paths are directories
+	size_t volatile			next;	// next path to take
+};
+
 
 //
 // Convert input files to absolute paths, skip excluded or not included
-// files, and skip non-regular or missing files.
+// files, and skip non-regular or missing files. Likewise with the created
+// directories. The paths are checked by several threads, as the realpath()
+// and lstat() calls may be slow on cold or network filesystems, and the
+// lstat() of each logged file is kept for later use.
 //
 void Logger::filter_files()
 {
-	vector<string> filtered;
-	struct stat s;
-	
-	for (set<string>::iterator p = m_files.begin(); p != m_files.end(); ++p) {
+	vector<string const*> paths;
+	vector<CheckedPath> results;
 
-		if ((*p).empty())
-			continue;
+	// the directories resolved while the command ran may have changed since
+	forget_real_dirs();
 
-		string path(clear_path((*p)));
+	// one sort for all the paths logged, as a path may be logged many times
 
-		// skip excluded or not included files
-		if (in_paths(path, Opt::exclude()) || !in_paths(path, Opt::include()))
-			continue;
+	std::sort(m_files.begin(), m_files.end());
+	m_files.erase(std::unique(m_files.begin(), m_files.end()), m_files.end());
+
+	paths.reserve(m_files.size());
+
+	for (vector<string>::const_iterator p = m_files.begin(); p != m_files.end(); ++p) {
+		if (!p->empty())
+			paths.push_back(&*p);
+	}
+
+	check_paths(paths, results, false);
+	vector<string>().swap(m_files);
+
+	// keep the logged files, sorted by path, as several input paths may
+	// lead to the same file
+
+	results.erase(std::remove_if(results.begin(), results.end(),
+		[](CheckedPath const& c) { return !c.logged; }), results.end());
+	
+	std::sort(results.begin(), results.end(), 
+		[](CheckedPath const& a, CheckedPath const& b) { return a.path < b.path; });
 	
+	results.erase(std::unique(results.begin(), results.end(),
+		[](CheckedPath const& a, CheckedPath const& b) { return a.path == b.path; }), 
+		results.end());
+
+	m_checked.swap(results);
+
+	// created directories that still exist
+
+	paths.clear();
+
+	for (vector<string>::const_iterator p = m_dirs.begin(); p != m_dirs.end(); ++p)
+		paths.push_back(&*p);
+
+	check_paths(paths, results, true);
+	vector<string>().swap(m_dirs);
+
+	m_checked_dirs.clear();
+
+	for (uint i(0); i < results.size(); ++i) {
+		if (results[i].logged)
+			m_checked_dirs.push_back(std::move(results[i].path));
+	}
+
+	std::sort(m_checked_dirs.begin(), m_checked_dirs.end());
+	m_checked_dirs.erase(std::unique(m_checked_dirs.begin(), m_checked_dirs.end()),
+		m_checked_dirs.end());
+}
+
+
+//
+// Check the paths (in parallel, if there are many) and store the results
+// in the same order.
+//
+void Logger::check_paths(vector<string const*> const& paths, vector<CheckedPath>& results,
+                         bool dirs) const
+{
+	uint const MIN_PATHS = 512;		// per thread
+	uint const MAX_THREADS = 8;
+
+	FilterJob job = { this, &paths, &results, dirs, 0 };
+	vector<pthread_t> threads;
+	long nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	results.assign(paths.size(), CheckedPath());
+
+	// compile the path lists before the threads use them
+	Opt::include_paths();
+	Opt::exclude_paths();
+
+	if (nthreads > (long)(paths.size() / MIN_PATHS))
+		nthreads = paths.size() / MIN_PATHS;
+	if (nthreads > (long)MAX_THREADS)
+		nthreads = MAX_THREADS;
+
+	// the calling thread works too
+	for (long i = 1; i < nthreads; ++i) {
+		pthread_t t;
+		if (pthread_create(&t, 0, check_thread, &job))
+			break;
+		threads.push_back(t);
+	}
+
+	check_thread(&job);
+
+	for (uint i(0); i < threads.size(); ++i)
+		pthread_join(threads[i], 0);
+}
+
+
+//
+// Take chunks of paths from the job and check them, until none is left.
+//
+void* Logger::check_thread(void* arg)
+{
+	size_t const CHUNK = 64;
+	FilterJob* job = static_cast<FilterJob*>(arg);
+	size_t const n = job->paths->size();
+
+	for (size_t i; (i = __sync_fetch_and_add(&job->next, CHUNK)) < n; ) {
+		for (size_t j = i; j < n && j < i + CHUNK; ++j)
+			job->logger->check_path(*(*job->paths)[j], (*job->results)[j], job->dirs);
+	}
+
+	return 0;
+}
+
+
+void Logger::check_path(string const& inpath, CheckedPath& ret, bool dir) const
+{
+	ret.path = (m_traced && !dir) ? update_path(inpath) : clear_path(inpath);
+	ret.logged = false;
+
+	// skip excluded or not included files
+	if (Opt::exclude_paths().match(ret.path) || !Opt::include_paths().match(ret.path))
+		return;
+
+	else if (lstat(ret.path.c_str(), &ret.st) < 0) {
 		// skip missing files, if needed
-		else if (lstat(path.c_str(), &s) < 0 && !Opt::log_missing())
+		memset(&ret.st, 0, sizeof(ret.st));
+		ret.logged = !dir && Opt::log_missing();
+	}
+
+	// log only regular files or symlinks, or directories
+	else if (dir)
+		ret.logged = S_ISDIR(ret.st.st_mode);
+	else if (S_ISLNK(ret.st.st_mode)) {
+		char ln[4096];
+		ssize_t cnt = readlink(ret.path.c_str(), ln, sizeof(ln) - 1);
+		ret.ln_name.assign(ln, cnt > 0 ? cnt : 0);
+		ret.logged = true;
+	}
+	else
+		ret.logged = S_ISREG(ret.st.st_mode);
+}
+
+
+//
+// Resolve again a path resolved by watch_channel(), if a directory above it
+// has been renamed, removed or replaced by a symlink since.
+//
+string Logger::update_path(string const& path) const
+{
+	for (string::size_type p = path.rfind('/'); p && p != string::npos; 
+	p = path.rfind('/', p - 1)) {
+		if (m_moved.count(path.substr(0, p)))
+			return clear_path(path);
+	}
+
+	return path;
+}
+
+
+//
+// Erase path, and the paths under it, from the set.
+//
+static void erase_tree(set<string>& paths, string const& path)
+{
+	paths.erase(path);
+
+	string dir(path + "/");
+	set<string>::iterator p = paths.lower_bound(dir);
+	
+	while (p != paths.end() && !p->compare(0, dir.size(), dir))
+		paths.erase(p++);
+}
+
+
+//
+// Move oldpath, and the paths under it, to newpath.
+//
+static void rename_tree(set<string>& paths, string const& oldpath, string const& newpath)
+{
+	string dir(oldpath + "/");
+	set<string>::iterator p = paths.lower_bound(dir);
+	vector<string> renamed;
+
+	if (paths.erase(oldpath))
+		renamed.push_back(newpath);
+	
+	while (p != paths.end() && !p->compare(0, dir.size(), dir)) {
+		renamed.push_back(newpath + p->substr(oldpath.size()));
+		paths.erase(p++);
+	}
+
+	paths.insert(renamed.begin(), renamed.end());
+}
+
+
+//
+// Add the paths of the files under directory dir.
+//
+static void add_tree(string const& dir, vector<string>& files)
+{
+	DIR* d = opendir(dir.c_str());
+	if (!d)
+		return;
+
+	vector<string> subdirs;
+	struct stat s;
+
+	for (dirent* e; (e = readdir(d)); ) {
+
+		if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, ".."))
 			continue;
 
-		// log only regular files or symlinks
-		else if (s.st_mode & (S_IFREG | S_IFLNK))
-			filtered.push_back(path);
+		string path(dir + "/" + e->d_name);
+
+		if (e->d_type == DT_DIR || (e->d_type == DT_UNKNOWN 
+		&& !lstat(path.c_str(), &s) && S_ISDIR(s.st_mode)))
+			subdirs.push_back(path);
+		else
+			files.push_back(path);
 	}
 
-	m_files.clear();
-	copy(filtered.begin(), filtered.end(), inserter(m_files, m_files.begin()));
+	closedir(d);
+
+	for (uint i(0); i < subdirs.size(); ++i)
+		add_tree(subdirs[i], files);
+}
+
+
+static bool is_newer(timespec const& t, timespec const& start)
+{
+	return t.tv_sec > start.tv_sec 
+		|| (t.tv_sec == start.tv_sec && t.tv_nsec >= start.tv_nsec);
 }
 
 
@@ -228,9 +1268,25 @@ static string search_libporg()
 }
 
 
+//
+// Run the command with the shell (in the child process).
+//
+static void exec_shell(string const& command, string const& title)
+{
+	Out::dbg("INCLUDE = " + Opt::include()); 
+	Out::dbg("EXCLUDE = " + Opt::exclude()); 
+	Out::dbg("command = " + command);
+	Out::dbg_title(title);
+
+	char* cmd[] = { (char*)"sh", (char*)"-c", (char*)(command.c_str()), 0 };
+	execv("/bin/sh", cmd);
+
+	throw Error("execv()", errno);
+}
+
+
 static void set_env(char const* var, string const& val)
 {
 	if (setenv(var, val.c_str(), 1) < 0)
 		throw Error(string("setenv('") + var + "', '" + val + "', 1)", errno);
 }
-
@@ -11,29 +11,117 @@
 
 #include "config.h"
 #include <iosfwd>
+#include <string>
 #include <set>
+#include <map>
+#include <vector>
+#include <stdint.h>
+
+struct porg_event;
 
 namespace Porg {
 
+//
+// A path checked by Logger::filter_files(). The logged files are passed
+// as such to NewPkg or Pkg::append().
+//
+struct CheckedPath
+{
+	std::string	path;		// clear_path() of the logged path
+	struct stat	st;			// lstat() of path (zeros if missing)
+	std::string	ln_name;	// contents of a symlink
+	std::string	digest;		// SHA-256 checksum, if logged with -k
+	bool		logged;		// passed the filter
+};
+
 class Logger
 {
 	public:
 
 	static void run();
 
+	~Logger();
+
 	protected:
 
 	std::string const		m_pkgname;
-	std::set<std::string> 	m_files;
+	std::string const		m_command;	// shell command line
+	pid_t					m_pid;		// the command, while it runs traced
+	int						m_status;	// wait status of the command
+	std::vector<std::string>	m_files;	// resolved, if m_traced
+	std::vector<std::string>	m_dirs;
+	std::set<std::string> 	m_renamed;	// renamed files and directories
+	int						m_fd;
+	std::string				m_fd_path;
+	std::string				m_tmpfile;
+	bool					m_traced;	// m_dirs is known
+	std::map<std::string, uint64_t>	m_stats;	// counters of libporg-log
+	uint					m_nstats;	// number of reports
+
+	// checksum of a file, and the status of the file when it was computed
+	struct Checksum {
+		std::string	digest;
+		off_t		size;
+		time_t		mtime;
+		ino_t		ino;
+	};
+	std::map<std::string, Checksum>	m_checksums;
+
+	// a rename, removal or created directory, to be applied in order
+	struct Event {
+		uint64_t	time;
+		int			op;
+		std::string	path;
+		std::string	path2;
+	};
+
+	std::vector<char>	m_channel;		// last record read, if incomplete
+	off_t				m_read;			// bytes of the channel read
+	bool				m_corrupted;	// a corrupted record was read
+	std::vector<Event>	m_events;		// see apply_events()
+	std::set<std::string>	m_moved;	// renamed, removed or symlinked paths (resolved)
+
+	struct FilterJob;
+	class Batch;
+
+	// the results of filter_files(), sorted by path without repeats
+	std::vector<CheckedPath>	m_checked;		// logged files
+	std::vector<std::string>	m_checked_dirs;	// created directories
 	
-	Logger();
+	Logger(std::string const& pkgname, std::string const& command);
 
+	static void run_batch();
+	static void read_batch_file(Batch&);
 	void read_files_from_command();
-	void exec_command(std::string const&) const;
+	void start_command();
+	void end_command();
+	bool running() const	{ return m_pid >= 0; }
+	std::string status() const;
+	bool read_files_from_manifest();
+	void open_channel();
+	void close_channel();
+	void exec_command();
+	void exec_command_seccomp();
+	void exec_command_fanotify();
 	void read_files_from_stream(std::istream&);
-	void write_files_to_pkg() const;
+	void read_channel();
+	void read_files_from_channel();
+	bool watch_channel();
+	void add_event(porg_event const&, std::string const&, std::string const&);
+	void apply_events();
+	void add_checksum(std::string const&);
+	std::string get_checksum(CheckedPath const&) const;
+	void add_renamed_dirs();
+	void add_stats(std::string const&, bool first);
+	void print_stats() const;
+	void write_files();
+	void write_files_to_pkg();
 	void write_files_to_stream(std::ostream&) const;
 	void filter_files();
+	std::string update_path(std::string const&) const;
+	void check_paths(std::vector<std::string const*> const&, std::vector<CheckedPath>&, bool) const;
+	void check_path(std::string const&, CheckedPath&, bool) const;
+	static void* check_thread(void*);
 
 }; 	// class Logger
 
@@ -7,29 +7,38 @@
 //=======================================================================
 
 #include "config.h"
-#include "porg/file.h"
 #include "porg/rexp.h"
 #include "newpkg.h"
+#include "logger.h"
 #include "out.h"
+#include "util.h"		// search_file()
 #include <string>
 #include <fstream>
-#include <glob.h>
 
 using std::string;
-using std::set;
 using namespace Porg;
 
 static void get_var(string const&, string const&, string&);
 static void get_define(string const&, string const&, string&);
-static string search_file(string const&);
 
 
-NewPkg::NewPkg(string const& name_, set<string> const& files_)
+NewPkg::NewPkg(string const& name_, std::vector<CheckedPath> const& files_, 
+               std::vector<string> const* dirs_ /* = 0 */)
 :
 	BasePkg(name_)
 {
-	for (set<string>::const_iterator f(files_.begin()); f != files_.end(); ++f)
-		log_file(*f);
+	size_t nbytes = 0;
+
+	for (std::vector<CheckedPath>::const_iterator f(files_.begin()); f != files_.end(); ++f)
+		nbytes += f->path.size() + f->ln_name.size() + f->digest.size() + 3;
+
+	m_files.reserve(files_.size(), nbytes);
+
+	for (std::vector<CheckedPath>::const_iterator f(files_.begin()); f != files_.end(); ++f)
+		log_file(f->path, f->st, f->ln_name, f->digest);
+
+	if (dirs_)
+		log_dirs(*dirs_);
 	
 	if (m_files.empty())
 		throw Error(m_name + ": No files to log");;
@@ -186,8 +195,8 @@ void NewPkg::get_icon_path()
 	bool found = false;
 
 	for (uint i(0); !found && i < m_files.size(); ++i) {
-		if (re.exec(m_files[i]->name())) {
-			path = m_files[i]->name();
+		if (re.exec(m_files[i].name())) {
+			path = m_files[i].name();
 			found = !access(path.c_str(), F_OK);
 		}
 	}
@@ -227,21 +236,3 @@ void get_define(string const& file, string const& tag, string& val)
 		}
 	}
 }
-
-
-string search_file(string const& name)
-{
-	glob_t g;
-	memset(&g, 0, sizeof(g));
-	
-	string file, patt[3] = { name, "*/" + name, "*/*/" + name };
-
-	for (int i = 0; i < 3 && file.empty(); ++i) {
-		if (!glob(patt[i].c_str(), 0, 0, &g) && g.gl_pathc)
-			file = g.gl_pathv[0];
-	}
-
-	globfree(&g);
-	return file;
-}
-
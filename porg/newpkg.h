@@ -12,17 +12,20 @@
 #include "config.h"
 #include "porg/basepkg.h"
 #include <iosfwd>
-#include <set>
+#include <vector>
 
 
 namespace Porg
 {
 
+struct CheckedPath;
+
 class NewPkg : public BasePkg
 {
 	public:
 
-	NewPkg(std::string const& name_, std::set<std::string> const& files);
+	NewPkg(std::string const& name_, std::vector<CheckedPath> const& files,
+	       std::vector<std::string> const* dirs = 0);
 	
 	protected:
 
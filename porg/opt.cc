@@ -9,6 +9,8 @@
 #include "config.h"
 #include "opt.h"
 #include "out.h"
+#include "seccomp.h"		// PORG_SECCOMP
+#include "fanotify.h"		// PORG_FANOTIFY
 #include "porg/common.h"
 #include <getopt.h>
 
@@ -36,12 +38,16 @@ bool Opt::s_remove_batch = false;
 bool Opt::s_remove_unlog = false;
 bool Opt::s_log_append = false;
 bool Opt::s_log_missing = false;
+bool Opt::s_log_checksums = false;
 bool Opt::s_reverse_sort = false;
 bool Opt::s_print_date = false;
 bool Opt::s_print_hour = false;
 bool Opt::s_logdir_created = false;
 sort_t Opt::s_sort_type = SORT_BY_NAME;
+method_t Opt::s_log_method = METHOD_PRELOAD;
+int Opt::s_log_jobs = 0;
 string Opt::s_log_pkg_name = "";
+string Opt::s_log_batch_file = "";
 int Opt::s_mode = MODE_DEFAULT;
 vector<string> Opt::s_args = vector<string>();
 char Opt::s_mode_char = 0;
@@ -80,11 +86,15 @@ Opt::Opt(int argc, char* argv[])
 		OPT_HELP 			= 'h',
 		OPT_INCLUDE			= 'I',
 		OPT_INFO			= 'i',
+		OPT_CHECKSUMS		= 'k',
 		OPT_LOGDIR			= 'L',
 		OPT_LOG				= 'l',
+		OPT_METHOD			= 'M',
 		OPT_CONF_OPTS		= 'o',
 		OPT_PACKAGE			= 'p',
 		OPT_LOG_MISSING		= 'j',
+		OPT_JOBS			= 'J',
+		OPT_BATCH_FILE		= 'P',
 		OPT_QUERY			= 'q',
 		OPT_REVERSE			= 'R',
 		OPT_REMOVE			= 'r',
@@ -133,6 +143,10 @@ Opt::Opt(int argc, char* argv[])
 		{ "append", 			0, 0, OPT_APPEND },
 		{ "dirname", 			0, 0, OPT_DIRNAME },
 		{ "log-missing", 		0, 0, OPT_LOG_MISSING },
+		{ "method", 			1, 0, OPT_METHOD },
+		{ "checksums", 			0, 0, OPT_CHECKSUMS },
+		{ "packages", 			1, 0, OPT_BATCH_FILE },
+		{ "jobs", 				1, 0, OPT_JOBS },
 		{ 0 ,0, 0, 0 },
 	};
 	
@@ -202,6 +216,10 @@ Opt::Opt(int argc, char* argv[])
 			case OPT_EXCLUDE:			s_exclude = optarg; break;
 			case OPT_APPEND:			s_log_append = true; break;
 			case OPT_LOG_MISSING:		s_log_missing = true; break;
+			case OPT_METHOD:			set_log_method(optarg); break;
+			case OPT_CHECKSUMS:			s_log_checksums = true; break;
+			case OPT_BATCH_FILE:		s_log_batch_file = optarg; break;
+			case OPT_JOBS:				set_log_jobs(optarg); break;
 
 			// unrecognized option
 			
@@ -260,6 +278,10 @@ Opt::Opt(int argc, char* argv[])
 			case OPT_EXCLUDE:
 			case OPT_APPEND:
 			case OPT_LOG_MISSING:
+			case OPT_METHOD:
+			case OPT_CHECKSUMS:
+			case OPT_BATCH_FILE:
+			case OPT_JOBS:
 				check_mode(MODE_LOG, c);
 				break;
 		}
@@ -284,8 +306,13 @@ Opt::Opt(int argc, char* argv[])
 				break;
 			
 			case OPT_APPEND:
+			case OPT_CHECKSUMS:
 				check_required(c, string(1, OPT_LOG));
-				check_required(c, string(1, OPT_PACKAGE) + OPT_DIRNAME);
+				check_required(c, string(1, OPT_PACKAGE) + OPT_DIRNAME + OPT_BATCH_FILE);
+				break;
+
+			case OPT_JOBS:
+				check_required(c, string(1, OPT_BATCH_FILE));
 				break;
 
 			case OPT_PACKAGE:
@@ -293,6 +320,8 @@ Opt::Opt(int argc, char* argv[])
 			case OPT_LOG_MISSING:
 			case OPT_EXCLUDE:
 			case OPT_INCLUDE:
+			case OPT_METHOD:
+			case OPT_BATCH_FILE:
 				check_required(c, string(1, OPT_LOG));
 				break;
 
@@ -323,7 +352,15 @@ Opt::Opt(int argc, char* argv[])
 			break;
 
 		case MODE_LOG:
-			if (!s_log_pkg_name.empty()) {
+			if (!s_log_batch_file.empty()) {
+				// the names and commands are read from the file
+				if (s_optchars.find_first_of(string(1, OPT_PACKAGE) + OPT_DIRNAME) != string::npos)
+					die_help(string("-") + OPT_BATCH_FILE + ": Incompatible with -" 
+						+ OPT_PACKAGE + " and -" + OPT_DIRNAME);
+				else if (!s_args.empty())
+					die_help(string("-") + OPT_BATCH_FILE + ": No command allowed");
+			}
+			if (!s_log_pkg_name.empty() || !s_log_batch_file.empty()) {
 				s_logdir_created = !mkdir(s_logdir.c_str(), 0755);
 				if (!logdir_writable())
 					throw Error(s_logdir, errno);
@@ -403,6 +440,38 @@ void Opt::set_sort_type(string const& s)
 }
 
 
+void Opt::set_log_method(string const& s)
+{
+	if (!s.compare(0, s.size(), "preload", s.size()))
+		s_log_method = METHOD_PRELOAD;
+	else if (!s.compare(0, s.size(), "seccomp", s.size())) {
+#if PORG_SECCOMP
+		s_log_method = METHOD_SECCOMP;
+#else
+		throw Error("Method 'seccomp' not supported on this system");
+#endif
+	}
+	else if (!s.compare(0, s.size(), "fanotify", s.size())) {
+#if PORG_FANOTIFY
+		s_log_method = METHOD_FANOTIFY;
+#else
+		throw Error("Method 'fanotify' not supported on this system");
+#endif
+	}
+	else if (!s.compare(0, s.size(), "manifest", s.size()))
+		s_log_method = METHOD_MANIFEST;
+	else
+		die_help("'" + s + "': Invalid argument for option '-M|--method'");
+}
+
+
+void Opt::set_log_jobs(string const& s)
+{
+	if ((s_log_jobs = str2num<int>(s)) < 1)
+		die_help("'" + s + "': Invalid argument for option '-J|--jobs'");
+}
+
+
 static void help()
 {
 cout <<
@@ -445,11 +514,20 @@ cout <<
 "  -p, --package=PKG        Name of the package to be logged.\n" 
 "  -D, --dirname            Use the name of the current directory as the name\n"
 "                           of the package.\n"
-"  -+, --append             With -p or -D: If the package is already logged,\n"
+"  -+, --append             With -p, -D or -P: If the package is already logged,\n"
 "                           append the list of files to its log.\n"
 "  -j, --log-missing        Do not skip missing files.\n"
 "  -I, --include=PATH:...   List of paths to scan.\n"
-"  -E, --exclude=PATH:...   List of paths to skip.\n\n"
+"  -E, --exclude=PATH:...   List of paths to skip.\n"
+"  -M, --method=WORD        Trace the command with WORD: 'preload' (default),\n"
+"                           'seccomp', 'fanotify' or 'manifest' (see the man\n"
+"                           page).\n"
+"  -k, --checksums          With -p, -D or -P: Log the SHA-256 checksum of\n"
+"                           each regular file.\n"
+"  -P, --packages=FILE      Log several packages, reading from FILE the name\n"
+"                           of each one and the command that installs it (see\n"
+"                           the man page).\n"
+"  -J, --jobs=N             With -P: Run up to N commands at a time.\n\n"
 "Note: The package list mode is enabled by default.\n\n"
 "Written by David Ricart <" PACKAGE_BUGREPORT ">"
 << endl;
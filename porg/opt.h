@@ -30,6 +30,15 @@ enum {
 };
 
 
+// methods to trace the command in log mode
+enum method_t {
+	METHOD_PRELOAD,
+	METHOD_SECCOMP,
+	METHOD_FANOTIFY,
+	METHOD_MANIFEST
+};
+
+
 class Opt : public BaseOpt
 {
 	public:
@@ -49,12 +58,16 @@ class Opt : public BaseOpt
 	static bool remove_unlog()		{ return s_remove_unlog; }
 	static bool log_append()		{ return s_log_append; }
 	static bool log_missing()		{ return s_log_missing; }
+	static bool log_checksums()		{ return s_log_checksums; }
 	static bool reverse_sort() 		{ return s_reverse_sort; }
 	static bool print_date() 		{ return s_print_date; }
 	static bool print_hour() 		{ return s_print_hour; }
 	static sort_t sort_type()		{ return s_sort_type; }
+	static method_t log_method()	{ return s_log_method; }
 	static int mode()				{ return s_mode; };
+	static int log_jobs()			{ return s_log_jobs; }
 	static std::string const& log_pkg_name()		{ return s_log_pkg_name; }
+	static std::string const& log_batch_file()	{ return s_log_batch_file; }
 	static std::vector<std::string> const& args()	{ return s_args; }
 	
 	protected:
@@ -65,6 +78,8 @@ class Opt : public BaseOpt
 	static void check_required(char, std::string const&);
 	static void set_mode(int m, char optchar);
 	static void set_sort_type(std::string const&);
+	static void set_log_method(std::string const&);
+	static void set_log_jobs(std::string const&);
 
 	static bool s_all_pkgs;
 	static bool s_exact_version;
@@ -77,12 +92,16 @@ class Opt : public BaseOpt
 	static bool s_remove_unlog;
 	static bool s_log_append;
 	static bool s_log_missing;
+	static bool s_log_checksums;
 	static bool s_reverse_sort;
 	static bool s_print_date;
 	static bool s_print_hour;
 	static bool s_logdir_created;
 	static sort_t	s_sort_type;
+	static method_t	s_log_method;
+	static int		s_log_jobs;
 	static std::string s_log_pkg_name;
+	static std::string s_log_batch_file;
 	static int s_mode;
 	static std::vector<std::string> s_args;
 	static char s_mode_char;
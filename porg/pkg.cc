@@ -12,26 +12,29 @@
 #include "opt.h"
 #include "db.h"
 #include "main.h"			// g_exit_status
-#include "porg/common.h"	// in_paths(), strip_trailing()
-#include "porg/file.h"
+#include "porg/common.h"	// strip_trailing()
+#include "logger.h"
 #include <string>
 #include <iomanip>
 
 using std::string;
 using std::cout;
 using std::endl;
-using std::set;
 using std::setw;
 using namespace Porg;
 
 static void remove_parent_dir(string const& path);
 
 
+//
+// Only the header of the log is read here; the files are read when first
+// needed.
+//
 Pkg::Pkg(string const& name_)
 :
 	BasePkg(name_)
 {
-	read_log();
+	read_log_header();
 }
 
 
@@ -51,17 +54,29 @@ void Pkg::print_info() const
 }
 
 
-void Pkg::append(set<string> const& files_)
+//
+// Append the files not logged yet. They are all looked up before any is
+// added, so that the files of the package stay sorted for the lookups.
+//
+void Pkg::append(std::vector<CheckedPath> const& files_, 
+                 std::vector<string> const* dirs_ /* = 0 */)
 {
-	bool appended(false);
+	std::vector<CheckedPath const*> news;
 
-	for (set<string>::const_iterator f(files_.begin()); f != files_.end(); ++f) {
-		if (!find_file(*f)) {
-			log_file(*f);
-			appended = true;
-		}
+	for (std::vector<CheckedPath>::const_iterator f(files_.begin()); f != files_.end(); ++f) {
+		if (!find_file(f->path))
+			news.push_back(&*f);
 	}
 
+	for (std::vector<CheckedPath const*>::const_iterator f(news.begin()); f != news.end(); ++f)
+		log_file((*f)->path, (*f)->st, (*f)->ln_name, (*f)->digest);
+
+	bool appended = !news.empty();
+
+	// the created directories are logged only if they were known already
+	if (dirs_ && m_dirs_logged && log_dirs(*dirs_))
+		appended = true;
+
 	if (appended)
 		write_log();
 }
@@ -111,12 +126,12 @@ void Pkg::list_files(int size_w)
 	for (const_iter f(m_files.begin()); f != m_files.end(); ++f) {
 
 		if (Opt::print_sizes())
-			cout << setw(size_w) << fmt_size((*f)->size()) << "  ";
+			cout << setw(size_w) << fmt_size(f->size()) << "  ";
 
-		cout << (*f)->name();
+		cout << f->c_name();
 
-		if (Opt::print_symlinks() && (*f)->is_symlink())
-			cout << " -> " << (*f)->ln_name();
+		if (Opt::print_symlinks() && f->is_symlink())
+			cout << " -> " << f->c_ln_name();
 
 		cout << endl;
 	}
@@ -125,34 +140,68 @@ void Pkg::list_files(int size_w)
 
 void Pkg::remove(DB const& db)
 {
-	for (iter f(m_files.begin()); f != m_files.end(); ++f) {
+	load_files();
+
+	// reused, not to allocate a string per file
+	string file;
+
+	for (const_iter f(m_files.begin()); f != m_files.end(); ++f) {
+
+		file = f->c_name();
 
 		// skip excluded
-		if (in_paths((*f)->name(), Opt::remove_skip()))
-			Out::vrb((*f)->name() + ": excluded");
+		if (Opt::remove_skip_paths().match(file))
+			Out::vrb(file + ": excluded");
 
 		// skip shared files
-		else if (is_shared(*f, db))
-			Out::vrb((*f)->name() + ": shared");
+		else if (is_shared(file, db))
+			Out::vrb(file + ": shared");
 
 		// remove file
-		else if (!unlink((*f)->name().c_str())) {
-			Out::vrb("Removed '" + (*f)->name());
-			remove_parent_dir((*f)->name());
+		else if (!unlink(file.c_str())) {
+			Out::vrb("Removed '" + file);
+			if (!m_dirs_logged)
+				remove_parent_dir(file);
 		}
 
 		// an error occurred
 		else if (errno != ENOENT) {
-			Out::vrb("Failed to remove '" + (*f)->name() + "'", errno);
+			Out::vrb("Failed to remove '" + file + "'", errno);
 			g_exit_status = EXIT_FAILURE;
 		}
 	}
 
+	remove_dirs();
+
 	if (g_exit_status == EXIT_SUCCESS)
 		unlog();
 }
 
 
+//
+// Remove the (empty) directories created by the package, bottom-up.
+//
+void Pkg::remove_dirs() const
+{
+	for (std::vector<string>::const_reverse_iterator d(m_dirs.rbegin()); 
+	d != m_dirs.rend(); ++d) {
+		
+		if (Opt::remove_skip_paths().match(*d))
+			Out::vrb(*d + ": excluded");
+
+		else if (!rmdir(d->c_str()))
+			Out::vrb("Removed directory '" + *d + "'");
+		
+		else if (errno != ENOENT && errno != ENOTEMPTY && errno != EEXIST)
+			Out::vrb("Failed to remove directory '" + *d + "'", errno);
+	}
+}
+
+
+//
+// Remove the parent directories of path, while empty (for packages logged
+// without their created directories).
+//
 static void remove_parent_dir(string const& path)
 {
 	string dir(strip_trailing(path, '/'));
@@ -12,13 +12,14 @@
 #include "config.h"
 #include "porg/basepkg.h"
 #include <iosfwd>
-#include <set>
+#include <vector>
 
 
 namespace Porg
 {
 
 class DB;
+struct CheckedPath;
 
 class Pkg : public BasePkg
 {
@@ -32,7 +33,12 @@ class Pkg : public BasePkg
 	void print_info() const;
 	void list(int, int) const;
 	void list_files(int size_w);
-	void append(std::set<std::string> const& files);
+	void append(std::vector<CheckedPath> const& files, 
+	            std::vector<std::string> const* dirs = 0);
+
+	private:
+
+	void remove_dirs() const;
 
 };	// class Pkg
 
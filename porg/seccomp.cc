@@ -0,0 +1,606 @@
+//=======================================================================
+// seccomp.cc
+//-----------------------------------------------------------------------
+// This file is part of the package porg
+// Copyright (C) 2015 David Ricart
+// For more information visit http://porg.sourceforge.net
+//=======================================================================
+
+#include "config.h"
+#include "seccomp.h"
+
+#if PORG_SECCOMP
+
+#include "out.h"
+#include "porg/common.h"
+#include "porg-log/event.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <poll.h>
+#include <stddef.h>
+#include <sys/ioctl.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+
+#if defined(__x86_64__)
+#	define PORG_AUDIT_ARCH AUDIT_ARCH_X86_64
+#elif defined(__i386__)
+#	define PORG_AUDIT_ARCH AUDIT_ARCH_I386
+#elif defined(__aarch64__)
+#	define PORG_AUDIT_ARCH AUDIT_ARCH_AARCH64
+#elif defined(__arm__)
+#	define PORG_AUDIT_ARCH AUDIT_ARCH_ARM
+#else
+#	define PORG_AUDIT_ARCH AUDIT_ARCH_RISCV64
+#endif
+
+// offset of the lower 32 bits of the i-th argument in struct seccomp_data
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#	define PORG_ARG_LO(i) (offsetof(seccomp_data, args) + 8 * (i))
+#else
+#	define PORG_ARG_LO(i) (offsetof(seccomp_data, args) + 8 * (i) + 4)
+#endif
+
+using std::string;
+using std::vector;
+using namespace Porg;
+
+static vector<sock_filter> build_filter();
+static sock_filter bpf_stmt(unsigned short code, uint32_t k);
+static sock_filter bpf_jump(unsigned short code, uint32_t k, size_t jt, size_t jf);
+static void send_fd(int sock, int fd);
+static int recv_fd(int sock);
+static bool read_string(pid_t, uint64_t addr, string&);
+
+
+//
+// The system calls passed to porg, and the index of the argument with
+// the open() flags (-1 to pass them always).
+//
+static struct {
+	long nr;
+	int flags_arg;
+} const s_syscalls[] = {
+#ifdef SYS_open
+	{ SYS_open,			1 },
+#endif
+#ifdef SYS_creat
+	{ SYS_creat,		-1 },
+#endif
+#ifdef SYS_rename
+	{ SYS_rename,		-1 },
+#endif
+#ifdef SYS_link
+	{ SYS_link,			-1 },
+#endif
+#ifdef SYS_symlink
+	{ SYS_symlink,		-1 },
+#endif
+#ifdef SYS_mkdir
+	{ SYS_mkdir,		-1 },
+#endif
+#ifdef SYS_unlink
+	{ SYS_unlink,		-1 },
+#endif
+#ifdef SYS_rmdir
+	{ SYS_rmdir,		-1 },
+#endif
+#ifdef SYS_openat2
+	{ SYS_openat2,		-1 },
+#endif
+#ifdef SYS_renameat2
+	{ SYS_renameat2,	-1 },
+#endif
+#ifdef SYS_renameat
+	{ SYS_renameat,		-1 },
+#endif
+	{ SYS_openat,		2 },
+	{ SYS_linkat,		-1 },
+	{ SYS_symlinkat,	-1 },
+	{ SYS_mkdirat,		-1 },
+	{ SYS_unlinkat,		-1 },
+};
+
+static size_t const s_nsyscalls = sizeof(s_syscalls) / sizeof(s_syscalls[0]);
+
+
+Seccomp::Seccomp(int fd)
+:
+	Tracer(fd, "seccomp"),
+	m_listener(-1),
+	m_pending()
+{
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, m_sock) < 0)
+		throw Error("socketpair()", errno);
+}
+
+
+Seccomp::~Seccomp()
+{
+	for (int i = 0; i < 2; ++i) {
+		if (m_sock[i] >= 0)
+			close(m_sock[i]);
+	}
+
+	if (m_listener >= 0)
+		close(m_listener);
+}
+
+
+//
+// Called by the child before running the command: Install the filter,
+// and pass the listener descriptor to the parent.
+// Once the filter is installed, no filtered system calls can be made
+// until the parent gets the listener, hence _exit() on errors (instead of
+// throwing, which would unwind through the copy of porg in the child).
+//
+void Seccomp::install()
+{
+	close(m_sock[0]);
+	m_sock[0] = -1;
+
+	vector<sock_filter> filter(build_filter());
+	sock_fprog prog;
+	prog.len = filter.size();
+	prog.filter = &filter[0];
+
+	int listener = syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER,
+		SECCOMP_FILTER_FLAG_NEW_LISTENER, &prog);
+
+	// without CAP_SYS_ADMIN, the process must not gain privileges, so
+	// setuid programs run by the command don't get them
+	if (listener < 0 && errno == EACCES) {
+		Out::vrb("porg: Not running as root: setuid programs run by the command "
+			"will not gain privileges");
+		if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) < 0) {
+			perror("porg: prctl(PR_SET_NO_NEW_PRIVS)");
+			_exit(EXIT_FAILURE);
+		}
+		listener = syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER,
+			SECCOMP_FILTER_FLAG_NEW_LISTENER, &prog);
+	}
+
+	if (listener < 0) {
+		perror("porg: seccomp(SECCOMP_SET_MODE_FILTER)");
+		_exit(EXIT_FAILURE);
+	}
+
+	send_fd(m_sock[1], listener);
+	close(listener);
+	close(m_sock[1]);
+	m_sock[1] = -1;
+}
+
+
+//
+// Called by the parent: Handle the notifications until the command exits.
+// Return the wait status of the command.
+// Processes left running in background by the command get ENOSYS from the
+// filtered system calls once porg exits.
+//
+int Seccomp::supervise(pid_t pid)
+{
+	int status = 0;
+
+	close(m_sock[1]);
+	m_sock[1] = -1;
+
+	if ((m_listener = recv_fd(m_sock[0])) < 0) {
+		waitpid(pid, 0, 0);
+		throw Error("Failed to install the seccomp filter");
+	}
+
+	seccomp_notif_sizes sizes;
+
+	if (syscall(SYS_seccomp, SECCOMP_GET_NOTIF_SIZES, 0, &sizes) < 0)
+		throw Error("seccomp(SECCOMP_GET_NOTIF_SIZES)", errno);
+
+	vector<char> req_buf(std::max<size_t>(sizes.seccomp_notif, sizeof(seccomp_notif)));
+	vector<char> resp_buf(std::max<size_t>(sizes.seccomp_notif_resp, sizeof(seccomp_notif_resp)));
+	seccomp_notif* req = reinterpret_cast<seccomp_notif*>(&req_buf[0]);
+	seccomp_notif_resp* resp = reinterpret_cast<seccomp_notif_resp*>(&resp_buf[0]);
+	bool exited = false;
+
+	while (true) {
+
+		pollfd p = { m_listener, POLLIN, 0 };
+		int cnt = poll(&p, 1, exited ? 0 : 50);
+
+		if (cnt < 0 && errno != EINTR)
+			throw Error("poll()", errno);
+
+		else if (cnt > 0 && (p.revents & POLLIN)) {
+
+			memset(req, 0, req_buf.size());
+
+			if (ioctl(m_listener, SECCOMP_IOCTL_NOTIF_RECV, req) < 0) {
+				if (errno == EINTR || errno == ENOENT)
+					continue;
+				throw Error("ioctl(SECCOMP_IOCTL_NOTIF_RECV)", errno);
+			}
+
+			handle(*req);
+
+			// let the system call run
+
+			memset(resp, 0, resp_buf.size());
+			resp->id = req->id;
+			resp->flags = SECCOMP_USER_NOTIF_FLAG_CONTINUE;
+
+			if (ioctl(m_listener, SECCOMP_IOCTL_NOTIF_SEND, resp) < 0 && errno != ENOENT)
+				throw Error("ioctl(SECCOMP_IOCTL_NOTIF_SEND)", errno);
+		}
+
+		// no processes left using the filter
+		else if (cnt > 0 && (p.revents & (POLLHUP | POLLERR)))
+			break;
+
+		else if (exited)
+			break;
+
+		else if (waitpid(pid, &status, WNOHANG) == pid)
+			exited = true;
+	}
+
+	// all the system calls are done now
+	check_pending();
+	flush();
+
+	if (!exited)
+		waitpid(pid, &status, 0);
+
+	return status;
+}
+
+
+//
+// Log a notified system call. The paths are read from the memory of the
+// process, which is blocked until the notification is replied.
+//
+void Seccomp::handle(seccomp_notif const& req)
+{
+	// the former system call of the thread, if any, is done
+	check_pending(req.pid);
+
+	pid_t const pid = req.pid;
+	__u64 const* a = req.data.args;
+	size_t const buf_size = m_buf.size();
+	string path, path2;
+	struct stat s;
+
+	switch (req.data.nr) {
+
+#ifdef SYS_open
+		case SYS_open:
+			log(PORG_OP_OPEN, pid, a[1], get_path(pid, AT_FDCWD, a[0]));
+			break;
+#endif
+		case SYS_openat:
+			log(PORG_OP_OPEN, pid, a[2], get_path(pid, a[0], a[1]));
+			break;
+
+#ifdef SYS_openat2
+		case SYS_openat2: {
+			// flags is the first member of struct open_how
+			uint64_t flags;
+			iovec local = { &flags, sizeof(flags) };
+			iovec remote = { reinterpret_cast<void*>(static_cast<uintptr_t>(a[2])), sizeof(flags) };
+			if (process_vm_readv(pid, &local, 1, &remote, 1, 0) == sizeof(flags)
+			&& (flags & (O_WRONLY | O_RDWR | O_CREAT)))
+				log(PORG_OP_OPEN, pid, flags, get_path(pid, a[0], a[1]));
+			break;
+		}
+#endif
+
+#ifdef SYS_creat
+		case SYS_creat:
+			log(PORG_OP_CREAT, pid, O_CREAT | O_WRONLY | O_TRUNC,
+				get_path(pid, AT_FDCWD, a[0]));
+			break;
+#endif
+
+#ifdef SYS_rename
+		case SYS_rename:
+			add_pending(pid, PORG_OP_RENAME, get_path(pid, AT_FDCWD, a[1]),
+				get_path(pid, AT_FDCWD, a[0]));
+			break;
+#endif
+#ifdef SYS_renameat
+		case SYS_renameat:
+#endif
+#ifdef SYS_renameat2
+		case SYS_renameat2:
+#endif
+			add_pending(pid, PORG_OP_RENAME, get_path(pid, a[2], a[3]), get_path(pid, a[0], a[1]));
+			break;
+
+#ifdef SYS_link
+		case SYS_link:
+			log(PORG_OP_LINK, pid, 0, get_path(pid, AT_FDCWD, a[1]),
+				get_path(pid, AT_FDCWD, a[0]));
+			break;
+#endif
+		case SYS_linkat:
+			log(PORG_OP_LINK, pid, 0, get_path(pid, a[2], a[3]), get_path(pid, a[0], a[1]));
+			break;
+
+#ifdef SYS_symlink
+		case SYS_symlink:
+			if (read_string(pid, a[0], path2))
+				log(PORG_OP_SYMLINK, pid, 0, get_path(pid, AT_FDCWD, a[1]), path2);
+			break;
+#endif
+		case SYS_symlinkat:
+			if (read_string(pid, a[0], path2))
+				log(PORG_OP_SYMLINK, pid, 0, get_path(pid, a[1], a[2]), path2);
+			break;
+
+		// the directory is created only if it does not exist yet
+
+#ifdef SYS_mkdir
+		case SYS_mkdir:
+			path = get_path(pid, AT_FDCWD, a[0]);
+			if (!path.empty() && lstat(path.c_str(), &s) < 0)
+				log(PORG_OP_MKDIR, pid, 0, path);
+			break;
+#endif
+		case SYS_mkdirat:
+			path = get_path(pid, a[0], a[1]);
+			if (!path.empty() && lstat(path.c_str(), &s) < 0)
+				log(PORG_OP_MKDIR, pid, 0, path);
+			break;
+
+#ifdef SYS_unlink
+		case SYS_unlink:
+			add_pending(pid, PORG_OP_UNLINK, get_path(pid, AT_FDCWD, a[0]));
+			break;
+#endif
+#ifdef SYS_rmdir
+		case SYS_rmdir:
+			add_pending(pid, PORG_OP_RMDIR, get_path(pid, AT_FDCWD, a[0]));
+			break;
+#endif
+		case SYS_unlinkat:
+			add_pending(pid, a[2] & AT_REMOVEDIR ? PORG_OP_RMDIR : PORG_OP_UNLINK,
+				get_path(pid, a[0], a[1]));
+			break;
+	}
+
+	// discard the paths if the process died meanwhile (its pid may have
+	// been reused)
+
+	if (m_buf.size() > buf_size
+	&& ioctl(m_listener, SECCOMP_IOCTL_NOTIF_ID_VALID, &req.id) < 0)
+		m_buf.resize(buf_size);
+
+	else if (m_buf.size() >= BUFSIZE)
+		flush();
+}
+
+
+//
+// Keep a removal or rename of thread tid, to be logged by check_pending()
+// once the system call is done.
+//
+void Seccomp::add_pending(pid_t tid, int op, string const& path, 
+                          string const& path2 /* = "" */)
+{
+	if (path.empty() || (op == PORG_OP_RENAME && path2.empty()))
+		return;
+
+	Pending p = { tid, op, now(), path, path2 };
+	m_pending.push_back(p);
+}
+
+
+//
+// Log the pending removals and renames of thread tid (of all the threads
+// if tid is 0), whose system calls are done, if they succeeded: The removed
+// path must be gone, and the renamed path must have been moved. They are
+// logged with the time of their notification, so that porg applies them in
+// the order they happened.
+//
+void Seccomp::check_pending(pid_t tid /* = 0 */)
+{
+	struct stat s;
+
+	for (size_t i = 0; i < m_pending.size(); ) {
+		
+		Pending const& p = m_pending[i];
+
+		if (tid && p.tid != tid) {
+			++i;
+			continue;
+		}
+		
+		if (lstat(p.path2.empty() ? p.path.c_str() : p.path2.c_str(), &s) < 0
+		&& (p.op != PORG_OP_RENAME || !lstat(p.path.c_str(), &s)))
+			log(p.op, p.tid, 0, p.path, p.path2, p.time);
+		
+		m_pending.erase(m_pending.begin() + i);
+	}
+}
+
+
+//
+// Read the path at address addr of process pid, and get its absolute path,
+// referring relative paths to the directory dirfd of the process, or to its
+// CWD. Return an empty string on error.
+//
+string Seccomp::get_path(pid_t pid, uint64_t dirfd, uint64_t addr)
+{
+	string path;
+
+	if (!read_string(pid, addr, path) || path.empty())
+		return "";
+
+	else if (path[0] == '/')
+		return path;
+
+	string proc("/proc/" + num2str(pid));
+	string dir(read_link((int)dirfd == AT_FDCWD
+		? proc + "/cwd" : proc + "/fd/" + num2str((int)dirfd)));
+
+	return dir.empty() ? "" : dir + "/" + path;
+}
+
+
+//
+// Build the BPF program of the filter:
+// Pass the filtered system calls to porg, if their flags (if any) contain
+// any of O_WRONLY, O_RDWR or O_CREAT, and allow any other system call.
+// Only the native ABI is filtered: the system calls of other ABIs (i386
+// or x32 programs on x86_64, 32-bit ARM programs on aarch64) have other
+// numbers, and are allowed without being logged.
+//
+static vector<sock_filter> build_filter()
+{
+	vector<sock_filter> f;
+	size_t size = 4 + 2;
+
+	for (size_t i = 0; i < s_nsyscalls; ++i)
+		size += s_syscalls[i].flags_arg < 0 ? 1 : 3;
+
+	size_t const allow = size - 2, notify = size - 1;
+
+	f.push_back(bpf_stmt(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, arch)));
+	f.push_back(bpf_jump(BPF_JMP | BPF_JEQ | BPF_K, PORG_AUDIT_ARCH, 1, 0));
+	f.push_back(bpf_stmt(BPF_RET | BPF_K, SECCOMP_RET_ALLOW));
+	f.push_back(bpf_stmt(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, nr)));
+
+	for (size_t i = 0; i < s_nsyscalls; ++i) {
+
+		size_t k = f.size();
+
+		if (s_syscalls[i].flags_arg < 0)
+			f.push_back(bpf_jump(BPF_JMP | BPF_JEQ | BPF_K,
+				s_syscalls[i].nr, notify - k - 1, 0));
+		else {
+			f.push_back(bpf_jump(BPF_JMP | BPF_JEQ | BPF_K,
+				s_syscalls[i].nr, 0, 2));
+			f.push_back(bpf_stmt(BPF_LD | BPF_W | BPF_ABS,
+				PORG_ARG_LO(s_syscalls[i].flags_arg)));
+			f.push_back(bpf_jump(BPF_JMP | BPF_JSET | BPF_K,
+				O_WRONLY | O_RDWR | O_CREAT, notify - k - 3, allow - k - 3));
+		}
+	}
+
+	f.push_back(bpf_stmt(BPF_RET | BPF_K, SECCOMP_RET_ALLOW));
+	f.push_back(bpf_stmt(BPF_RET | BPF_K, SECCOMP_RET_USER_NOTIF));
+
+	assert(f.size() == size);
+
+	return f;
+}
+
+
+static sock_filter bpf_stmt(unsigned short code, uint32_t k)
+{
+	sock_filter ret = BPF_STMT(code, k);
+	return ret;
+}
+
+
+static sock_filter bpf_jump(unsigned short code, uint32_t k, size_t jt, size_t jf)
+{
+	sock_filter ret = BPF_JUMP(code, k, (unsigned char)jt, (unsigned char)jf);
+	return ret;
+}
+
+
+static void send_fd(int sock, int fd)
+{
+	char c = 0;
+	iovec iov = { &c, 1 };
+	char ctl[CMSG_SPACE(sizeof(int))];
+	msghdr msg;
+
+	memset(&msg, 0, sizeof(msg));
+	memset(ctl, 0, sizeof(ctl));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = ctl;
+	msg.msg_controllen = sizeof(ctl);
+
+	cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+	if (sendmsg(sock, &msg, 0) != 1) {
+		// can't throw here, see Seccomp::install()
+		perror("porg: sendmsg()");
+		_exit(EXIT_FAILURE);
+	}
+}
+
+
+static int recv_fd(int sock)
+{
+	char c;
+	iovec iov = { &c, 1 };
+	char ctl[CMSG_SPACE(sizeof(int))];
+	msghdr msg;
+	int fd = -1;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = ctl;
+	msg.msg_controllen = sizeof(ctl);
+
+	ssize_t cnt;
+	while ((cnt = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR) ;
+
+	cmsghdr* cmsg = cnt > 0 ? CMSG_FIRSTHDR(&msg) : 0;
+
+	if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+		memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+
+	return fd;
+}
+
+
+//
+// Read a null terminated string from the memory of a process, page by page,
+// so as not to read past its mapped memory.
+//
+static bool read_string(pid_t pid, uint64_t addr, string& str)
+{
+	char buf[4096];
+
+	str.clear();
+
+	while (str.size() < 4096) {
+
+		size_t len = sizeof(buf) - addr % sizeof(buf);
+		iovec local = { buf, len };
+		iovec remote = { reinterpret_cast<void*>(static_cast<uintptr_t>(addr)), len };
+		ssize_t cnt = process_vm_readv(pid, &local, 1, &remote, 1, 0);
+
+		if (cnt <= 0)
+			return false;
+
+		char* end = static_cast<char*>(memchr(buf, 0, cnt));
+
+		if (end) {
+			str.append(buf, end - buf);
+			return true;
+		}
+
+		str.append(buf, cnt);
+		addr += cnt;
+	}
+
+	return false;
+}
+
+
+#endif	// PORG_SECCOMP
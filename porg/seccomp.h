@@ -0,0 +1,76 @@
+//=======================================================================
+// seccomp.h
+//-----------------------------------------------------------------------
+// This file is part of the package porg
+// Copyright (C) 2015 David Ricart
+// For more information visit http://porg.sourceforge.net
+//=======================================================================
+
+#ifndef PORG_SECCOMP_H
+#define PORG_SECCOMP_H
+
+#include "config.h"
+
+#if HAVE_LINUX_SECCOMP_H && HAVE_DECL_SECCOMP_USER_NOTIF_FLAG_CONTINUE \
+	&& HAVE_PROCESS_VM_READV && (defined(__x86_64__) || defined(__i386__) \
+	|| defined(__aarch64__) || defined(__arm__) \
+	|| (defined(__riscv) && __riscv_xlen == 64))
+#	define PORG_SECCOMP 1
+#endif
+
+#if PORG_SECCOMP
+
+#include "tracer.h"
+#include <stdint.h>
+
+struct seccomp_notif;
+
+
+namespace Porg {
+
+//
+// Tracer based on seccomp user notifications: The command runs with a
+// seccomp filter that passes the file creating system calls (only) to
+// porg, which logs them to the channel with the same event records
+// written by libporg-log, and lets the kernel go on with them.
+// Unlike LD_PRELOAD, it works with statically linked programs too.
+// The notifications come before the system calls run, so removals and
+// renames are logged only once they are seen done (see check_pending()).
+//
+class Seccomp : public Tracer
+{
+	public:
+
+	Seccomp(int fd);
+	~Seccomp();
+
+	void install();
+	int supervise(pid_t pid);
+
+	private:
+
+	// a removal or rename not known to be done yet
+	struct Pending {
+		pid_t		tid;		// the calling thread
+		int			op;
+		uint64_t	time;		// of the notification
+		std::string	path;
+		std::string	path2;
+	};
+
+	int						m_sock[2];	// to pass the listener to the parent
+	int						m_listener;
+	std::vector<Pending>	m_pending;
+
+	void handle(seccomp_notif const&);
+	void add_pending(pid_t, int op, std::string const& path, std::string const& path2 = "");
+	void check_pending(pid_t tid = 0);
+	std::string get_path(pid_t, uint64_t dirfd, uint64_t addr);
+
+};	// class Seccomp
+
+}	// namespace Porg
+
+#endif	// PORG_SECCOMP
+
+#endif	// PORG_SECCOMP_H
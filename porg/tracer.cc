@@ -0,0 +1,113 @@
+//=======================================================================
+// tracer.cc
+//-----------------------------------------------------------------------
+// This file is part of the package porg
+// Copyright (C) 2015 David Ricart
+// For more information visit http://porg.sourceforge.net
+//=======================================================================
+
+#include "config.h"
+#include "out.h"
+#include "porg/common.h"
+#include "porg-log/event.h"
+#include "tracer.h"
+#include <fcntl.h>
+
+using std::string;
+using std::vector;
+using namespace Porg;
+
+
+Tracer::Tracer(int fd, string const& name)
+:
+	m_fd(fd),
+	m_name(name),
+	m_buf()
+{ }
+
+
+//
+// Add an event record to m_buf, skipping paths in /dev and /proc, as
+// libporg-log does. The record is timed now, unless time is given.
+//
+void Tracer::log(int op, pid_t pid, int flags, string const& path,
+                 string const& path2 /* = "" */, uint64_t time /* = 0 */)
+{
+	if (path.empty() || !path.compare(0, 5, "/dev/") || !path.compare(0, 6, "/proc/"))
+		return;
+
+	if (op == PORG_OP_OPEN && !(flags & (O_WRONLY | O_RDWR | O_CREAT)))
+		return;
+
+	porg_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.time = time ? time : now();
+	ev.op = op;
+	ev.pid = pid;
+	ev.flags = flags;
+	ev.path_len = path.size();
+	ev.path2_len = path2.size();
+	ev.size = PORG_EVENT_SIZE(ev.path_len, ev.path2_len);
+
+	size_t off = m_buf.size();
+	m_buf.resize(off + ev.size, 0);
+	memcpy(&m_buf[off], &ev, sizeof(ev));
+	memcpy(&m_buf[off + sizeof(ev)], path.data(), path.size());
+	memcpy(&m_buf[off + sizeof(ev) + path.size()], path2.data(), path2.size());
+
+	if (Out::debug())
+		Out::dbg(m_name + " :: " + num2str(pid) + ": " + path 
+			+ (path2.empty() ? "" : " <- " + path2));
+}
+
+
+//
+// Log a rename, once done (porg adds the contents of renamed directories
+// later), if newpath still exists.
+//
+void Tracer::log_rename(pid_t pid, string const& oldpath, string const& newpath)
+{
+	struct stat s;
+
+	if (!oldpath.empty() && !newpath.empty() && !lstat(newpath.c_str(), &s))
+		log(PORG_OP_RENAME, pid, 0, newpath, oldpath);
+}
+
+
+//
+// Write the buffered records to the channel.
+//
+void Tracer::flush()
+{
+	for (ssize_t cnt, done = 0; done < (ssize_t)m_buf.size(); done += cnt) {
+		if ((cnt = write(m_fd, &m_buf[done], m_buf.size() - done)) < 0) {
+			if (errno == EINTR)
+				cnt = 0;
+			else
+				throw Error("write()", errno);
+		}
+	}
+
+	m_buf.clear();
+}
+
+
+//
+// Time of the event records: CLOCK_MONOTONIC, in nanoseconds.
+//
+uint64_t Tracer::now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+string Tracer::read_link(string const& path)
+{
+	char buf[4096];
+	ssize_t cnt = readlink(path.c_str(), buf, sizeof(buf) - 1);
+
+	return cnt > 0 ? string(buf, cnt) : "";
+}
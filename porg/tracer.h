@@ -0,0 +1,51 @@
+//=======================================================================
+// tracer.h
+//-----------------------------------------------------------------------
+// This file is part of the package porg
+// Copyright (C) 2015 David Ricart
+// For more information visit http://porg.sourceforge.net
+//=======================================================================
+
+#ifndef PORG_TRACER_H
+#define PORG_TRACER_H
+
+#include "config.h"
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+
+namespace Porg {
+
+//
+// Base class of the tracing methods run by porg itself (instead of by
+// libporg-log within the traced processes), which write to the channel
+// the same event records as libporg-log.
+//
+class Tracer
+{
+	protected:
+
+	// size of m_buf to be flushed
+	static size_t const BUFSIZE = 64 * 1024;
+
+	Tracer(int fd, std::string const& name);
+
+	int					m_fd;		// the channel
+	std::string const	m_name;		// for debugging messages
+	std::vector<char>	m_buf;		// records to be written to the channel
+
+	void log(int op, pid_t, int flags, std::string const& path,
+	         std::string const& path2 = "", uint64_t time = 0);
+	void log_rename(pid_t, std::string const& oldpath, std::string const& newpath);
+	void flush();
+
+	static std::string read_link(std::string const&);
+	static uint64_t now();
+
+};	// class Tracer
+
+}	// namespace Porg
+
+
+#endif	// PORG_TRACER_H
@@ -10,11 +10,28 @@
 #include "util.h"
 #include "porg/common.h"	// Error, strip_trailing()
 #include <string>
+#include <map>
+#include <glob.h>
+#include <pthread.h>
 
 using std::string;
 using namespace Porg;
 
 
+//
+// Cache of the directories resolved by clear_path(): Each absolute directory,
+// and each of its parents, as given, mapped to its realpath(). A directory
+// is resolved starting from its longest cached parent, so that only the
+// components not seen before are read with readlink().
+// The cache is shared by the threads of Logger::filter_files().
+//
+static std::map<string, string>	s_real_dirs;
+static string					s_cwd;
+static pthread_mutex_t			s_real_dirs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static bool resolve_dir(string const& dir, string& real, int depth = 0);
+
+
 //
 // Like libc's realpath(), but it only resolves symlinks in the partial
 // directories of the path, thereby retaining symlinks as symlinks.
@@ -29,9 +46,14 @@ string Porg::clear_path(string const& inpath)
 	// absolutize path
 
 	if (path[0] != '/') {
-		char cwd[4096];
-		if (getcwd(cwd, sizeof(cwd)))
-			path.insert(0, string(cwd) + "/");
+		pthread_mutex_lock(&s_real_dirs_lock);
+		if (s_cwd.empty()) {
+			char cwd[4096];
+			if (getcwd(cwd, sizeof(cwd)))
+				s_cwd = cwd;
+		}
+		path.insert(0, s_cwd + "/");
+		pthread_mutex_unlock(&s_real_dirs_lock);
 	}
 
 	path = strip_trailing(path, '/');
@@ -44,12 +66,130 @@ string Porg::clear_path(string const& inpath)
 
 	// get realpath of dirname
 
-	char real_dir[4096];
+	string real_dir;
 
-	if (!::realpath(dir.c_str(), real_dir))
+	if (dir.empty() || dir[0] != '/' || !resolve_dir(dir, real_dir))
 		return path;
 
-	return string(real_dir) + "/" + base;
+	return (real_dir == "/" ? "" : real_dir) + "/" + base;
+}
+
+
+//
+// Forget the cached directories, which may have changed (e.g. renamed by
+// an installation).
+//
+void Porg::forget_real_dirs()
+{
+	pthread_mutex_lock(&s_real_dirs_lock);
+	s_real_dirs.clear();
+	s_cwd.clear();
+	pthread_mutex_unlock(&s_real_dirs_lock);
+}
+
+
+static bool find_real_dir(string const& dir, string& real)
+{
+	pthread_mutex_lock(&s_real_dirs_lock);
+	std::map<string, string>::const_iterator p = s_real_dirs.find(dir);
+	bool found = p != s_real_dirs.end();
+	if (found)
+		real = p->second;
+	pthread_mutex_unlock(&s_real_dirs_lock);
+	
+	return found;
+}
+
+
+static void add_real_dir(string const& dir, string const& real)
+{
+	pthread_mutex_lock(&s_real_dirs_lock);
+	s_real_dirs[dir] = real;
+	pthread_mutex_unlock(&s_real_dirs_lock);
+}
+
+
+//
+// Get the realpath() of the absolute directory dir. Fail if it does not
+// exist, or in a symlink loop.
+//
+static bool resolve_dir(string const& dir, string& real, int depth /* = 0 */)
+{
+	if (depth > 40)		// like ELOOP
+		return false;
+
+	// longest parent already resolved ("" stands for "/")
+	
+	string done;
+	string::size_type pos = dir.size();
+
+	while (pos > 0 && !find_real_dir(dir.substr(0, pos), done))
+		pos = dir.rfind('/', pos - 1);
+
+	if (done == "/")
+		done.clear();
+
+	// resolve the rest, one component at a time
+
+	while (pos < dir.size()) {
+
+		string::size_type end = dir.find('/', pos + 1);
+		if (end == string::npos)
+			end = dir.size();
+
+		string name(dir.substr(pos + 1, end - pos - 1));
+
+		if (name.empty() || name == ".")
+			;
+		else if (name == "..")
+			done.erase(done.empty() ? 0 : done.rfind('/'));
+		else {
+			char ln[4096];
+			ssize_t cnt = readlink((done + "/" + name).c_str(), ln, sizeof(ln) - 1);
+			
+			if (cnt > 0) {
+				// a symlink: resolve its target followed by the rest
+				string target(ln, cnt);
+				if (target[0] != '/')
+					target.insert(0, done + "/");
+				if (!resolve_dir(strip_trailing(target + dir.substr(end), '/'), real, depth + 1))
+					return false;
+				add_real_dir(dir, real);
+				return true;
+			}
+			else if (errno != EINVAL)	// missing, or not a directory
+				return false;
+			
+			done += "/" + name;
+		}
+
+		pos = end;
+		add_real_dir(dir.substr(0, pos), done.empty() ? "/" : done);
+	}
+
+	real = done.empty() ? "/" : done;
+	return true;
+}
+
+
+//
+// Search the file name in the current directory, and in the two levels of
+// subdirectories below it. Return the first path found, or an empty string.
+//
+string Porg::search_file(string const& name)
+{
+	glob_t g;
+	memset(&g, 0, sizeof(g));
+	
+	string file, patt[3] = { name, "*/" + name, "*/*/" + name };
+
+	for (int i = 0; i < 3 && file.empty(); ++i) {
+		if (!glob(patt[i].c_str(), 0, 0, &g) && g.gl_pathc)
+			file = g.gl_pathv[0];
+	}
+
+	globfree(&g);
+	return file;
 }
 
 
@@ -17,6 +17,8 @@
 namespace Porg
 {
 	std::string clear_path(std::string const&);
+	void forget_real_dirs();
+	std::string search_file(std::string const&);
 
 
 class Dir